@@ -31,9 +31,9 @@ foreach my $conf (</usr/local/dsc/etc/*.conf>) {
 	next unless chdir $rundir;
 
 	
-	while (<*.xml>) {
+	while (<*.xml *.bin *.jsonl *.gz *.zst>) {
         	my $old = $_;
-        	unless (/^(\d+)\.\w+\.xml$/) {
+        	unless (/^(\d+)\.\w+\.(xml|bin|jsonl)(\.gz|\.zst)?$/) {
                 	print "skipping $old\n";
                 	next;
         	}
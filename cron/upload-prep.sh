@@ -44,7 +44,7 @@ for conf in /usr/local/dsc/etc/*.conf ; do
 	#xec > $PROG.out
 	#xec 2>&1
 
-	k=`ls -r | grep xml$ | head -400` || true
+	k=`ls -r | grep -E '\.(xml|bin|jsonl)(\.gz|\.zst)?$' | head -400` || true
 	test -z "$k" && continue
 
 	for up in upload/* ; do
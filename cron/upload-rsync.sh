@@ -39,7 +39,7 @@ if test -f $HOME/.ssh/dsc_uploader_id ; then
 	export RSYNC_RSH
 fi
 
-k=`ls -r | grep xml$ | head -500` || true
+k=`ls -r | grep -E '\.(xml|bin|jsonl)(\.gz|\.zst)?$' | head -500` || true
 if test -n "$k" ; then
     rsync -av --remove-source-files $k $RPATH/incoming/$YYYYMMDD/
     # rsync -av $k $RPATH/incoming/$YYYYMMDD/ | grep '\.xml$' | xargs rm -v
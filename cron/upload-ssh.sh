@@ -43,7 +43,7 @@ YYYYMMDD=`ls | grep '^[0-9][0-9][0-9][0-9]-[0-9][0-9]-[0-9][0-9]$' | head -1`
 test -n "$YYYYMMDD" || exit 0
 cd $YYYYMMDD
 
-k=`ls -r | grep \.xml$ | head -500` || true
+k=`ls -r | grep -E '\.(xml|bin|jsonl)(\.gz|\.zst)?$' | head -500` || true
 if test -n "$k" ; then
 
     # dsc receiver doesn't like + in filename
@@ -44,7 +44,7 @@ YYYYMMDD=`ls | grep '^[0-9][0-9][0-9][0-9]-[0-9][0-9]-[0-9][0-9]$' | head -1`
 test -n "$YYYYMMDD" || exit 0
 cd $YYYYMMDD
 
-k=`ls -r | grep xml$ | head -500` || true
+k=`ls -r | grep -E '\.(xml|bin|jsonl)(\.gz|\.zst)?$' | head -500` || true
 if test -n "$k" ; then
     $MD5 $k > MD5s
     TF=`mktemp /tmp/put.XXXXXXXXXXXXX`
@@ -17,6 +17,17 @@ extern "C" int add_local_address(const char *);
 extern "C" int open_interface(const char *);
 extern "C" int set_run_dir(const char *);
 extern "C" int set_minfree_bytes(const char *);
+extern "C" int set_interval(const char *);
+extern "C" int add_rollup_interval(const char *);
+extern "C" int set_sample_rate(const char *);
+extern "C" int set_sample_drop_threshold(const char *);
+extern "C" int set_huge_pages(const char *);
+extern "C" int set_output_format(const char *);
+extern "C" int set_output_compression(const char *);
+extern "C" int set_output_delta(const char *, const char *);
+extern "C" int set_live_stats(const char *);
+extern "C" int set_metrics_listen(const char *);
+extern "C" int set_output_socket(const char *, const char *);
 extern "C" int set_pid_file(const char *);
 extern "C" int add_dataset(const char *name, const char *layer,
 	const char *firstname, const char *firstindexer,
@@ -48,6 +59,17 @@ Rule rHostOrNet;
 Rule rInterface("Interface", 0);
 Rule rRunDir("RunDir", 0);
 Rule rMinfreeBytes("MinfreeBytes", 0);
+Rule rInterval("Interval", 0);
+Rule rRollupInterval("RollupInterval", 0);
+Rule rSampleRate("SampleRate", 0);
+Rule rSampleDropThreshold("SampleDropThreshold", 0);
+Rule rHugePages("HugePages", 0);
+Rule rOutputFormat("OutputFormat", 0);
+Rule rOutputCompression("OutputCompression", 0);
+Rule rOutputDelta("OutputDelta", 0);
+Rule rLiveStats("LiveStats", 0);
+Rule rMetricsListen("MetricsListen", 0);
+Rule rOutputSocket("OutputSocket", 0);
 Rule rPidFile("PidFile", 0);
 Rule rLocalAddr("LocalAddr", 0);
 Rule rPacketFilterProg("PacketFilterProg", 0);
@@ -80,6 +102,19 @@ getDatasetOptVal(const Pree tree, string name, int &val)
 }
 
 
+static int
+getDatasetOptStr(const Pree tree, string name, string &val)
+{
+	for (unsigned int i=0; i<tree.count(); i++) {
+		if (0 != tree[i][0].image().compare(name))
+			continue;
+		val = tree[i][2].image();
+		return true;
+	}
+	return false;
+}
+
+
 /* interpret()
  *
  * I'm a recursive function.
@@ -109,6 +144,83 @@ interpret(const Pree &tree, int level)
 			return 0;
 		}
 	} else
+        if (tree.rid() == rInterval.id()) {
+		assert(tree.count() > 1);
+                if (set_interval(tree[1].image().c_str()) != 1) {
+			cerr << "interpret() failure in interval" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rRollupInterval.id()) {
+		assert(tree.count() > 1);
+                if (add_rollup_interval(tree[1].image().c_str()) != 1) {
+			cerr << "interpret() failure in rollup_interval" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rSampleRate.id()) {
+		assert(tree.count() > 1);
+                if (set_sample_rate(tree[1].image().c_str()) != 1) {
+			cerr << "interpret() failure in sample_rate" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rSampleDropThreshold.id()) {
+		assert(tree.count() > 1);
+                if (set_sample_drop_threshold(tree[1].image().c_str()) != 1) {
+			cerr << "interpret() failure in sample_drop_threshold" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rHugePages.id()) {
+		assert(tree.count() > 1);
+                if (set_huge_pages(tree[1].image().c_str()) != 1) {
+			cerr << "interpret() failure in huge_pages" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rOutputFormat.id()) {
+		assert(tree.count() > 1);
+                if (set_output_format(tree[1].image().c_str()) != 1) {
+			cerr << "interpret() failure in output_format" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rOutputCompression.id()) {
+		assert(tree.count() > 1);
+                if (set_output_compression(tree[1].image().c_str()) != 1) {
+			cerr << "interpret() failure in output_compression" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rOutputDelta.id()) {
+		assert(tree.count() > 2);
+                if (set_output_delta(tree[1].image().c_str(), tree[2].image().c_str()) != 1) {
+			cerr << "interpret() failure in output_delta" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rLiveStats.id()) {
+		assert(tree.count() > 1);
+                if (set_live_stats(remove_quotes(tree[1].image()).c_str()) != 1) {
+			cerr << "interpret() failure in live_stats" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rMetricsListen.id()) {
+		assert(tree.count() > 1);
+                if (set_metrics_listen(remove_quotes(tree[1].image()).c_str()) != 1) {
+			cerr << "interpret() failure in metrics_listen" << endl;
+			return 0;
+		}
+	} else
+        if (tree.rid() == rOutputSocket.id()) {
+		assert(tree.count() > 2);
+                if (set_output_socket(remove_quotes(tree[1].image()).c_str(), tree[2].image().c_str()) != 1) {
+			cerr << "interpret() failure in output_socket" << endl;
+			return 0;
+		}
+	} else
         if (tree.rid() == rPidFile.id()) {
 		assert(tree.count() > 1);
                 if (set_pid_file(remove_quotes(tree[1].image()).c_str()) != 1) {
@@ -127,10 +239,30 @@ interpret(const Pree &tree, int level)
 		dataset_opt opts;
 		opts.min_count = 0;	// min cell count to report
 		opts.max_cells = 0;	// max 2nd dim cells to print
+		opts.sparse = -1;	// cell storage: automatic
+		opts.weight = DATASET_WEIGHT_COUNT;
+		opts.topk = 0;		// exact counts
+		opts.hll = 0;		// count cells, not distinct values
+		opts.max_keys = 0;	// no indexer limit
 		assert(tree.count() > 10);
 		for (unsigned int i=10; i<tree.count(); i++) {
+			string weight;
 			getDatasetOptVal(tree[i], "min-count", opts.min_count);
 			getDatasetOptVal(tree[i], "max-cells", opts.max_cells);
+			getDatasetOptVal(tree[i], "sparse", opts.sparse);
+			getDatasetOptVal(tree[i], "topk", opts.topk);
+			getDatasetOptVal(tree[i], "hll", opts.hll);
+			getDatasetOptVal(tree[i], "max-keys", opts.max_keys);
+			if (!getDatasetOptStr(tree[i], "weight", weight))
+				continue;
+			if (0 == weight.compare("count"))
+				opts.weight = DATASET_WEIGHT_COUNT;
+			else if (0 == weight.compare("msglen"))
+				opts.weight = DATASET_WEIGHT_MSGLEN;
+			else {
+				cerr << "unknown dataset weight '" << weight << "'" << endl;
+				return 0;
+			}
 		}
 		x = add_dataset(tree[1].image().c_str(),	// name
 			tree[2].image().c_str(),		// layer
@@ -212,10 +344,21 @@ ParseConfig(const char *fn)
 	rInterface = "interface" >>rBareToken >>";" ;
 	rRunDir = "run_dir" >>rQuotedToken >>";" ;
 	rMinfreeBytes = "minfree_bytes" >>rDecimalNumber >>";" ;
+	rInterval = "interval" >>rDecimalNumber >>";" ;
+	rRollupInterval = "rollup_interval" >>rDecimalNumber >>";" ;
+	rSampleRate = "sample_rate" >>rDecimalNumber >>";" ;
+	rSampleDropThreshold = "sample_drop_threshold" >>rDecimalNumber >>";" ;
+	rHugePages = "huge_pages" >>rDecimalNumber >>";" ;
+	rOutputFormat = "output_format" >>rBareToken >>";" ;
+	rOutputCompression = "output_compression" >>rBareToken >>";" ;
+	rOutputDelta = "output_delta" >>rBareToken >>rDecimalNumber >>";" ;
+	rLiveStats = "live_stats" >>rQuotedToken >>";" ;
+	rMetricsListen = "metrics_listen" >>rQuotedToken >>";" ;
+	rOutputSocket = "output_socket" >>rQuotedToken >>rDecimalNumber >>";" ;
 	rPidFile = "pid_file" >>rQuotedToken >>";" ;
 	rLocalAddr = "local_address" >>rIPAddress >>";" ;
 	rPacketFilterProg = "bpf_program" >>rQuotedToken >>";" ;
-	rDatasetOpt = rBareToken >> "=" >> rDecimalNumber;
+	rDatasetOpt = rBareToken >> "=" >> (rDecimalNumber | rBareToken);
 	rDataset = "dataset" >>rBareToken >>rBareToken
 		>>rBareToken >>":" >>rBareToken
 		>>rBareToken >>":" >>rBareToken
@@ -230,6 +373,17 @@ ParseConfig(const char *fn)
 		rInterface |
 		rRunDir |
 		rMinfreeBytes |
+		rInterval |
+		rRollupInterval |
+		rSampleRate |
+		rSampleDropThreshold |
+		rHugePages |
+		rOutputFormat |
+		rOutputCompression |
+		rOutputDelta |
+		rLiveStats |
+		rMetricsListen |
+		rOutputSocket |
 		rPidFile |
 		rLocalAddr |
 		rPacketFilterProg |
@@ -257,6 +411,17 @@ ParseConfig(const char *fn)
         rInterface.committed(true);
         rRunDir.committed(true);
         rMinfreeBytes.committed(true);
+        rInterval.committed(true);
+        rRollupInterval.committed(true);
+        rSampleRate.committed(true);
+        rSampleDropThreshold.committed(true);
+        rHugePages.committed(true);
+        rOutputFormat.committed(true);
+        rOutputCompression.committed(true);
+        rOutputDelta.committed(true);
+        rLiveStats.committed(true);
+        rMetricsListen.committed(true);
+        rOutputSocket.committed(true);
         rLocalAddr.committed(true);
         rPacketFilterProg.committed(true);
         rDataset.committed(true);
@@ -6,6 +6,8 @@
 #include "dns_message.h"
 #include "md_array.h"
 #include "hashtbl.h"
+#include "hll.h"
+#include "index_limit.h"
 
 static hashfunc ipaddr_hashfunc;
 static hashkeycmp ipaddr_cmpfunc;
@@ -13,6 +15,7 @@ static hashkeycmp ipaddr_cmpfunc;
 #define MAX_ARRAY_SZ 65536
 static hashtbl *theHash = NULL;
 static int next_idx = 0;
+static index_limit limit;
 
 typedef struct {
 	inX_addr addr;
@@ -34,6 +37,8 @@ cip_indexer(const void *vp)
     }
     if ((obj = hash_find(&m->client_ip_addr, theHash)))
 	return obj->index;
+    if (index_limit_reached(&limit, next_idx))
+	return limit.max_keys;
     obj = acalloc(1, sizeof(*obj));
     if (NULL == obj)
 	return -1;
@@ -43,6 +48,7 @@ cip_indexer(const void *vp)
 	afree(obj);
 	return -1;
     }
+    limit.bytes += sizeof(*obj) + HASH_ITEM_BYTES;
     next_idx++;
     return obj->index;
 }
@@ -56,10 +62,11 @@ cip_iterator(char **label)
 	return -1;
     if (NULL == label) {
 	hash_iter_init(theHash);
-	return next_idx;
+	index_limit_iter_init(&limit);
+	return next_idx + 1;
     }
     if ((obj = hash_iterate(theHash)) == NULL)
-	return -1;
+	return index_limit_iterate(&limit, label);
     inXaddr_ntop(&obj->addr, label_buf, 128);
     *label = label_buf;
     return obj->index;
@@ -70,6 +77,29 @@ cip_reset()
 {
     theHash = NULL;
     next_idx = 0;
+    index_limit_reset(&limit);
+}
+
+void
+cip_max_keys(int max_keys)
+{
+    index_limit_set(&limit, max_keys);
+}
+
+int
+cip_stats(char **label, uint64_t *val)
+{
+    return index_limit_stats(&limit, next_idx, label, val);
+}
+
+int
+cip_hasher(const void *vp, uint64_t *hash)
+{
+    const dns_message *m = vp;
+    if (m->malformed)
+	return -1;
+    *hash = hll_hash(&m->client_ip_addr, sizeof(m->client_ip_addr));
+    return 0;
 }
 
 static unsigned int
@@ -84,6 +114,6 @@ ipaddr_cmpfunc(const void *a, const void *b)
 {
 	const inX_addr *a1 = a;
 	const inX_addr *a2 = b;
-	return inXaddr_cmp(a1, a2);
+	return !inXaddr_equal(a1, a2);
 }
 
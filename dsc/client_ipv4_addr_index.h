@@ -1,3 +1,6 @@
 int cip_indexer(const void *);
 int cip_iterator(char **label);
 void cip_reset(void);
+void cip_max_keys(int);
+int cip_stats(char **label, uint64_t *val);
+int cip_hasher(const void *, uint64_t *);
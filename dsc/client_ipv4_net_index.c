@@ -6,9 +6,12 @@
 #include "dns_message.h"
 #include "md_array.h"
 #include "hashtbl.h"
+#include "hll.h"
+#include "index_limit.h"
 
 static hashfunc ipnet_hashfunc;
 static hashkeycmp ipnet_cmpfunc;
+static inX_addr cip_net_mask(const dns_message *);
 static inX_addr v4mask;
 #if USE_IPV6
 static inX_addr v6mask;
@@ -17,6 +20,7 @@ static inX_addr v6mask;
 #define MAX_ARRAY_SZ 65536
 static hashtbl *theHash = NULL;
 static int next_idx = 0;
+static index_limit limit;
 
 typedef struct {
 	inX_addr addr;
@@ -37,14 +41,11 @@ cip_net_indexer(const void *vp)
 	if (NULL == theHash)
 	    return -1;
     }
-#if USE_IPV6
-    if (6 == inXaddr_version(&m->client_ip_addr))
-	masked_addr = inXaddr_mask(&m->client_ip_addr, &v6mask);
-    else
-#endif
-	masked_addr = inXaddr_mask(&m->client_ip_addr, &v4mask);
+    masked_addr = cip_net_mask(m);
     if ((obj = hash_find(&masked_addr, theHash)))
 	return obj->index;
+    if (index_limit_reached(&limit, next_idx))
+	return limit.max_keys;
     obj = acalloc(1, sizeof(*obj));
     if (NULL == obj)
 	return -1;
@@ -54,6 +55,7 @@ cip_net_indexer(const void *vp)
 	afree(obj);
 	return -1;
     }
+    limit.bytes += sizeof(*obj) + HASH_ITEM_BYTES;
     next_idx++;
     return obj->index;
 }
@@ -67,10 +69,11 @@ cip_net_iterator(char **label)
 	return -1;
     if (NULL == label) {
 	hash_iter_init(theHash);
-	return next_idx;
+	index_limit_iter_init(&limit);
+	return next_idx + 1;
     }
     if ((obj = hash_iterate(theHash)) == NULL)
-	return -1;
+	return index_limit_iterate(&limit, label);
     inXaddr_ntop(&obj->addr, label_buf, 128);
     *label = label_buf;
     return obj->index;
@@ -81,6 +84,31 @@ cip_net_reset()
 {
     theHash = NULL;
     next_idx = 0;
+    index_limit_reset(&limit);
+}
+
+void
+cip_net_max_keys(int max_keys)
+{
+    index_limit_set(&limit, max_keys);
+}
+
+int
+cip_net_stats(char **label, uint64_t *val)
+{
+    return index_limit_stats(&limit, next_idx, label, val);
+}
+
+int
+cip_net_hasher(const void *vp, uint64_t *hash)
+{
+    const dns_message *m = vp;
+    inX_addr masked_addr;
+    if (m->malformed)
+	return -1;
+    masked_addr = cip_net_mask(m);
+    *hash = hll_hash(&masked_addr, sizeof(masked_addr));
+    return 0;
 }
 
 void
@@ -93,6 +121,16 @@ cip_net_indexer_init(void)
 #endif
 }
 
+static inX_addr
+cip_net_mask(const dns_message *m)
+{
+#if USE_IPV6
+    if (6 == inXaddr_version(&m->client_ip_addr))
+	return inXaddr_mask(&m->client_ip_addr, &v6mask);
+#endif
+    return inXaddr_mask(&m->client_ip_addr, &v4mask);
+}
+
 static unsigned int
 ipnet_hashfunc(const void *key)
 {
@@ -105,5 +143,5 @@ ipnet_cmpfunc(const void *a, const void *b)
 {
 	const inX_addr *a1 = a;
 	const inX_addr *a2 = b;
-	return inXaddr_cmp(a1, a2);
+	return !inXaddr_equal(a1, a2);
 }
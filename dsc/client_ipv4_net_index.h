@@ -1,3 +1,6 @@
 int cip_net_indexer(const void *);
 int cip_net_iterator(char **label);
 void cip_net_reset(void);
+void cip_net_max_keys(int);
+int cip_net_stats(char **label, uint64_t *val);
+int cip_net_hasher(const void *, uint64_t *);
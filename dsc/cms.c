@@ -0,0 +1,80 @@
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xmalloc.h"
+#include "cms.h"
+
+count_min *
+cms_create(unsigned int width, unsigned int depth)
+{
+    count_min *c = xcalloc(1, sizeof(*c));
+    if (NULL == c)
+	return NULL;
+    c->width = width;
+    c->depth = depth;
+    c->counters = xcalloc(width * depth, sizeof(*c->counters));
+    if (NULL == c->counters) {
+	xfree(c);
+	return NULL;
+    }
+    return c;
+}
+
+void
+cms_clear(count_min *c)
+{
+    memset(c->counters, 0, c->width * c->depth * sizeof(*c->counters));
+    c->total = 0;
+}
+
+/*
+ * The row hashes are h1 + i * h2 (Kirsch & Mitzenmacher), taken from
+ * the two halves of one 64 bit hash.
+ */
+static uint32_t *
+cms_counter(const count_min *c, uint64_t hash, unsigned int row)
+{
+    uint32_t h1 = hash >> 32;
+    uint32_t h2 = hash | 1;
+    return &c->counters[row * c->width + ((h1 + row * h2) & (c->width - 1))];
+}
+
+/*
+ * Adds 'n' and returns the new estimate.  Conservative update: only
+ * counters that would end up below the new estimate are raised.
+ */
+uint32_t
+cms_add(count_min *c, uint64_t hash, uint32_t n)
+{
+    uint32_t est = UINT32_MAX;
+    unsigned int i;
+    for (i = 0; i < c->depth; i++) {
+	uint32_t v = *cms_counter(c, hash, i);
+	if (v < est)
+	    est = v;
+    }
+    if (est > UINT32_MAX - n)
+	est = UINT32_MAX;
+    else
+	est += n;
+    for (i = 0; i < c->depth; i++) {
+	uint32_t *v = cms_counter(c, hash, i);
+	if (*v < est)
+	    *v = est;
+    }
+    c->total += n;
+    return est;
+}
+
+/*
+ * e / width * total, rounded up.
+ */
+uint64_t
+cms_error_bound(const count_min *c)
+{
+    return (uint64_t) (2.718281828 * c->total / c->width) + 1;
+}
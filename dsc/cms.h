@@ -0,0 +1,30 @@
+#ifndef CMS_H
+#define CMS_H
+
+#include "config.h"
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+/*
+ * Count-Min sketch (Cormode & Muthukrishnan) with conservative update.
+ *
+ * 'depth' rows of 'width' counters.  An estimate is never too small,
+ * and with probability 1 - exp(-depth) it is too large by no more than
+ * cms_error_bound().  The sketch has a fixed size and is malloc'ed
+ * rather than kept in the arena, so it can be reused across intervals.
+ */
+
+typedef struct {
+    unsigned int width;		/* power of two */
+    unsigned int depth;
+    uint32_t *counters;
+    uint64_t total;		/* sum of everything added */
+} count_min;
+
+count_min *cms_create(unsigned int width, unsigned int depth);
+void cms_clear(count_min *);
+uint32_t cms_add(count_min *, uint64_t hash, uint32_t n);
+uint64_t cms_error_bound(const count_min *);
+
+#endif /* CMS_H */
@@ -4,10 +4,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "xmalloc.h"
 #include "dns_message.h"
 #include "ip_message.h"
+#include "md_array.h"
+#include "rollup.h"
+#include "sample.h"
+#include "output.h"
+#include "delta.h"
+#include "live.h"
+#include "metrics.h"
+#include "stream.h"
 #include "syslog_debug.h"
 
 int promisc_flag;
@@ -16,6 +25,7 @@ void Ncap_init(const char *device, int promisc);
 #endif
 void Pcap_init(const char *device, int promisc);
 uint64_t minfree_bytes = 0;
+int report_interval = 60;
 
 int
 open_interface(const char *interface)
@@ -120,3 +130,86 @@ set_minfree_bytes(const char *s)
     minfree_bytes = strtoull(s, NULL, 10);
     return 1;
 }
+
+int
+set_interval(const char *s)
+{
+    syslog(LOG_INFO, "interval %s", s);
+    report_interval = atoi(s);
+    if (report_interval <= 0) {
+	syslog(LOG_ERR, "bad interval '%s'", s);
+	return 0;
+    }
+    return 1;
+}
+
+int
+add_rollup_interval(const char *s)
+{
+    syslog(LOG_INFO, "rollup_interval %s", s);
+    return rollup_add_interval(atoi(s));
+}
+
+int
+set_sample_rate(const char *s)
+{
+    syslog(LOG_INFO, "sample_rate %s", s);
+    return sample_set_rate(atoi(s));
+}
+
+int
+set_sample_drop_threshold(const char *s)
+{
+    syslog(LOG_INFO, "sample_drop_threshold %s", s);
+    return sample_set_drop_threshold(atoi(s));
+}
+
+int
+set_huge_pages(const char *s)
+{
+    syslog(LOG_INFO, "huge_pages %s", s);
+    arenaHugePages(atoi(s) != 0);
+    return 1;
+}
+
+int
+set_output_format(const char *s)
+{
+    syslog(LOG_INFO, "output_format %s", s);
+    return output_set_format(s);
+}
+
+int
+set_output_compression(const char *s)
+{
+    syslog(LOG_INFO, "output_compression %s", s);
+    return output_set_compression(s);
+}
+
+int
+set_live_stats(const char *s)
+{
+    syslog(LOG_INFO, "live_stats %s", s);
+    return live_open(s);
+}
+
+int
+set_metrics_listen(const char *s)
+{
+    syslog(LOG_INFO, "metrics_listen %s", s);
+    return metrics_set_listen(s);
+}
+
+int
+set_output_socket(const char *s, const char *mb)
+{
+    syslog(LOG_INFO, "output_socket %s %s", s, mb);
+    return stream_set_path(s, atoi(mb));
+}
+
+int
+set_output_delta(const char *mode, const char *every)
+{
+    syslog(LOG_INFO, "output_delta %s %s", mode, every);
+    return delta_set_mode(mode, atoi(every));
+}
@@ -12,6 +12,7 @@
 #include "dns_message.h"
 #include "md_array.h"
 #include "hashtbl.h"
+#include "index_limit.h"
 
 static hashfunc country_hashfunc;
 static hashkeycmp country_cmpfunc;
@@ -19,6 +20,7 @@ static hashkeycmp country_cmpfunc;
 #define MAX_ARRAY_SZ 65536
 static hashtbl *theHash = NULL;
 static int next_idx = 0;
+static index_limit limit;
 static GeoIP *geoip;
 static char *ipstr;
 static char unknown[20] = "__";
@@ -64,6 +66,8 @@ country_indexer(const void *vp)
     }
     if ((obj = hash_find(country, theHash)))
 	return obj->index;
+    if (index_limit_reached(&limit, next_idx))
+	return limit.max_keys;
     obj = acalloc(1, sizeof(*obj));
     if (NULL == obj)
 	return -1;
@@ -78,6 +82,7 @@ country_indexer(const void *vp)
 	afree(obj);
 	return -1;
     }
+    limit.bytes += sizeof(*obj) + strlen(obj->country) + 1 + HASH_ITEM_BYTES;
     next_idx++;
     return obj->index;
 }
@@ -92,10 +97,11 @@ country_iterator(char **label)
     if (NULL == label) {
 	/* initialize and tell caller how big the array is */
 	hash_iter_init(theHash);
-	return next_idx;
+	index_limit_iter_init(&limit);
+	return next_idx + 1;
     }
     if ((obj = hash_iterate(theHash)) == NULL)
-	return -1;
+	return index_limit_iterate(&limit, label);
     snprintf(label_buf, MAX_QNAME_SZ, "%s", obj->country);
     *label = label_buf;
     return obj->index;
@@ -106,6 +112,19 @@ country_reset()
 {
     theHash = NULL;
     next_idx = 0;
+    index_limit_reset(&limit);
+}
+
+void
+country_max_keys(int max_keys)
+{
+    index_limit_set(&limit, max_keys);
+}
+
+int
+country_stats(char **label, uint64_t *val)
+{
+    return index_limit_stats(&limit, next_idx, label, val);
 }
 
 static unsigned int
@@ -4,3 +4,5 @@
 int country_indexer(const void *);
 int country_iterator(char **label);
 void country_reset(void);
+void country_max_keys(int);
+int country_stats(char **label, uint64_t *val);
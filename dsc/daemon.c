@@ -11,7 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/wait.h>
+#include <pthread.h>
 #include <syslog.h>
 #include <stdarg.h>
 #include <errno.h>
@@ -38,6 +38,14 @@
 #if HAVE_LIBNCAP
 #include "ncap.h"
 #endif
+#include "md_array.h"
+#include "rollup.h"
+#include "sample.h"
+#include "snapshot.h"
+#include "output.h"
+#include "delta.h"
+#include "metrics.h"
+#include "stream.h"
 #include "syslog_debug.h"
 
 char *progname = NULL;
@@ -53,6 +61,7 @@ extern void country_indexer_init(void);
 extern void ParseConfig(const char *);
 extern uint64_t minfree_bytes;
 extern int n_pcap_offline;
+extern int report_interval;
 
 void
 daemonize(void)
@@ -135,60 +144,306 @@ usage(void)
 }
 
 static int
-dump_reports(void)
+interval_start_time(void)
 {
-    int fd;
-    FILE *fp;
-    char fname[128];
-    char tname[128];
+#if HAVE_LIBNCAP
+    return Ncap_start_time();
+#else
+    return Pcap_start_time();
+#endif
+}
 
-    if (disk_is_full()) {
-	syslog(LOG_NOTICE, "%s", "Not enough free disk space to write XML files");
-	return 1;
-    }
+static int
+interval_finish_time(void)
+{
 #if HAVE_LIBNCAP
-    snprintf(fname, 128, "%d.dscdata.xml", Ncap_finish_time());
+    return Ncap_finish_time();
 #else
-    snprintf(fname, 128, "%d.dscdata.xml", Pcap_finish_time());
+    return Pcap_finish_time();
 #endif
+}
+
+/*
+ * How much arena memory the interval's data took.
+ */
+static void
+arena_report(md_array_printer *pr, FILE *fp)
+{
+    arena_stats st;
+    char *all = "ALL";
+    arenaStats(&st);
+    pr->start_array(fp, "arena_stats");
+    pr->d1_type(fp, "All");
+    pr->d2_type(fp, "Statistic");
+    pr->start_data(fp);
+    pr->d1_begin(fp, all);
+    pr->print_element(fp, "bytes_used", st.used);
+    pr->print_element(fp, "bytes_reserved", st.reserved);
+    pr->print_element(fp, "chunks", st.chunks);
+    pr->print_element(fp, "chunks_pooled", st.pooled);
+    pr->d1_end(fp, all);
+    pr->finish_data(fp);
+    pr->finish_array(fp);
+}
+
+/*
+ * Freezes the interval that just ended, and clears the datasets for
+ * the next one.
+ */
+static snapshot *
+interval_snapshot(void)
+{
+    snapshot *s = snapshot_begin(interval_start_time(), interval_finish_time());
+    if (NULL == s) {
+	freeArena();
+	useArena();
+	dns_message_clear_arrays();
+	return NULL;
+    }
+    arena_report(&snapshot_recorder, NULL);
+    pcap_report(&snapshot_recorder, NULL);
+    sample_report(&snapshot_recorder, NULL);
+    dns_message_snapshot(s);
+    snapshot_end(s);
+    dns_message_clear_arrays();
+    return s;
+}
+
+static void
+interval_report(FILE *fp, void *s)
+{
+    snapshot_report(s, delta_printer(output_printer()), fp);
+}
+
+static void
+rollup_level_report(FILE *fp, void *l)
+{
+    dns_message_report_rollup(output_printer(), fp, l);
+}
+
+static int
+dump_report(const char *fname, void (*report)(FILE *, void *), void *ctx)
+{
+    int fd;
+    FILE *fp;
+    char tname[128];
+
     snprintf(tname, 128, "%s.XXXXXXXXX", fname);
     fd = mkstemp(tname);
     if (fd < 0) {
 	syslog(LOG_ERR, "%s: %s", tname, strerror(errno));
 	return 1;
     }
-    fp = fdopen(fd, "w");
+    /*
+     * XXX need chmod because files are written as root, but may be processed
+     * by a non-priv user
+     */
+    fchmod(fd, 0664);
+    fp = output_fdopen(fd);
     if (NULL == fp) {
 	syslog(LOG_ERR, "%s: %s", tname, strerror(errno));
 	close(fd);
+	unlink(tname);
 	return 1;
     }
     if (debug_flag)
 	fprintf(stderr, "writing to %s\n", tname);
-    fprintf(fp, "<dscdata>\n");
+    output_begin(fp);
     /* amalloc_report(); */
-    pcap_report(fp);
-    dns_message_report(fp);
-    fprintf(fp, "</dscdata>\n");
-
+    report(fp, ctx);
+    output_end(fp);
     /*
-     * XXX need chmod because files are written as root, but may be processed
-     * by a non-priv user
+     * A compressed file is finished only when its stream is closed,
+     * so a failed fclose() leaves nothing worth renaming.
      */
-    fchmod(fd, 0664);
-    fclose(fp);
+    if (fclose(fp) != 0) {
+	syslog(LOG_ERR, "%s: %s", tname, strerror(errno));
+	unlink(tname);
+	return 1;
+    }
     if (debug_flag)
 	fprintf(stderr, "renaming to %s\n", fname);
     rename(tname, fname);
     return 0;
 }
 
+/*
+ * With output_socket, reports are written into memory and queued to
+ * be streamed (stream.h) instead.
+ */
+static int
+stream_report(const char *fname, void (*report)(FILE *, void *), void *ctx)
+{
+    int fd;
+    int dfd;
+    FILE *fp;
+
+    fd = stream_tmpfile();
+    if (fd < 0) {
+	syslog(LOG_ERR, "%s: %s", fname, strerror(errno));
+	return 1;
+    }
+    dfd = dup(fd);		/* fclose() closes it; fd stays for stream_add() */
+    if (dfd < 0 || NULL == (fp = output_fdopen(dfd))) {
+	syslog(LOG_ERR, "%s: %s", fname, strerror(errno));
+	if (dfd >= 0)
+	    close(dfd);
+	close(fd);
+	return 1;
+    }
+    if (debug_flag)
+	fprintf(stderr, "streaming %s\n", fname);
+    output_begin(fp);
+    report(fp, ctx);
+    output_end(fp);
+    if (fclose(fp) != 0) {
+	syslog(LOG_ERR, "%s: %s", fname, strerror(errno));
+	close(fd);
+	return 1;
+    }
+    return stream_add(fname, fd);
+}
+
+/*
+ * Writes <finish>.dscdata.xml for the interval that just ended, and
+ * <finish>.dscdata_<N>s.xml for each rollup interval that ended with it
+ * (.bin or .jsonl instead of .xml for the other output formats, plus .gz
+ * or .zst when the output is compressed).  With output_delta, interval
+ * files between keyframes are <finish>.dscdata_delta.xml or
+ * <finish>.dscdata_cumulative.xml.  With output_socket, the same files
+ * are streamed instead.
+ */
+static int
+dump_reports(snapshot *s)
+{
+    char fname[128];
+    rollup_level *l;
+    int (*dump)(const char *, void (*)(FILE *, void *), void *) = dump_report;
+
+    if (stream_enabled()) {
+	dump = stream_report;
+    } else if (disk_is_full()) {
+	syslog(LOG_NOTICE, "%s", "Not enough free disk space to write XML files");
+	delta_failed();
+	return 1;
+    }
+    snprintf(fname, 128, "%d.dscdata%s.%s", snapshot_finish_time(s),
+	delta_begin(), output_suffix());
+    if (dump(fname, interval_report, s)) {
+	delta_failed();
+	return 1;
+    }
+    for (l = rollup_due(NULL); l; l = rollup_due(l)) {
+	snprintf(fname, 128, "%d.dscdata_%ds.%s",
+	    rollup_finish_time(l), rollup_interval(l), output_suffix());
+	if (dump(fname, rollup_level_report, l))
+	    return 1;
+    }
+    return 0;
+}
+
+/* ==== WRITER THREAD ===================================================== */
+
+/*
+ * Reports are written by a long lived thread while the next interval
+ * is being collected.  There is one snapshot in flight at most: the
+ * collector waits for the previous one to be written before handing
+ * over the next, and frees it, since the arenas are not thread safe.
+ * The rollups due with a snapshot are written along with it, and are
+ * not touched by the collector until then.
+ */
+static pthread_t writer;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static snapshot *writer_pending = NULL;	/* handed over, being written */
+static snapshot *writer_done = NULL;	/* written, to be freed */
+static int writer_exit = 0;
+
+static void *
+writer_main(void *unused)
+{
+    snapshot *s;
+    struct timeval t0;
+    struct timeval t1;
+    int x;
+    pthread_mutex_lock(&writer_lock);
+    for (;;) {
+	while (NULL == writer_pending && !writer_exit)
+	    pthread_cond_wait(&writer_cond, &writer_lock);
+	if (NULL == (s = writer_pending))
+	    break;
+	pthread_mutex_unlock(&writer_lock);
+	gettimeofday(&t0, NULL);
+	x = dump_reports(s);
+	if (stream_enabled())
+	    stream_flush(time(NULL) + report_interval / 2);
+	gettimeofday(&t1, NULL);
+	metrics_interval(s, t1.tv_sec - t0.tv_sec + (t1.tv_usec - t0.tv_usec) / 1e6, x);
+	pthread_mutex_lock(&writer_lock);
+	writer_pending = NULL;
+	writer_done = s;
+	pthread_cond_broadcast(&writer_cond);
+    }
+    pthread_mutex_unlock(&writer_lock);
+    if (stream_enabled())
+	stream_finish(time(NULL) + 5);
+    return NULL;
+}
+
+static void
+writer_start(void)
+{
+    int x = pthread_create(&writer, NULL, writer_main, NULL);
+    if (x) {
+	syslog(LOG_ERR, "pthread_create: %s", strerror(x));
+	exit(1);
+    }
+}
+
+/*
+ * Waits until the last snapshot handed over is written, and frees it.
+ */
+static void
+writer_wait(void)
+{
+    snapshot *s;
+    pthread_mutex_lock(&writer_lock);
+    while (writer_pending)
+	pthread_cond_wait(&writer_cond, &writer_lock);
+    s = writer_done;
+    writer_done = NULL;
+    pthread_mutex_unlock(&writer_lock);
+    if (s)
+	snapshot_free(s);
+}
+
+static void
+writer_hand_over(snapshot *s)
+{
+    pthread_mutex_lock(&writer_lock);
+    writer_pending = s;
+    pthread_cond_broadcast(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+static void
+writer_stop(void)
+{
+    writer_wait();
+    pthread_mutex_lock(&writer_lock);
+    writer_exit = 1;
+    pthread_cond_broadcast(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+    pthread_join(writer, NULL);
+}
+
 int
 main(int argc, char *argv[])
 {
     int x;
     extern DMC dns_message_handle;
     int result;
+    snapshot *s;
     struct timeval break_start = {0,0};
 
     progname = xstrdup(strrchr(argv[0], '/') ? strchr(argv[0], '/') + 1 : argv[0]);
@@ -225,19 +480,24 @@ main(int argc, char *argv[])
     country_indexer_init();
 #endif
     cip_net_indexer_init();
+    if (!rollup_check(report_interval))
+	exit(1);
 
     if (!nodaemon_flag)
     	daemonize();
     write_pid_file();
+    metrics_start();
 
     if (!debug_flag && 0 == n_pcap_offline) {
-        syslog(LOG_INFO, "Sleeping for %d seconds", 60 - (int) (time(NULL) % 60));
-        sleep(60 - (time(NULL) % 60));
+        syslog(LOG_INFO, "Sleeping for %d seconds",
+	    report_interval - (int) (time(NULL) % report_interval));
+        sleep(report_interval - (time(NULL) % report_interval));
     }
     syslog(LOG_INFO, "%s", "Running");
 
+    writer_start();
+    useArena(); /* Initialize a memory arena for data collection. */
     do {
-	useArena(); /* Initialize a memory arena for data collection. */
 	if (debug_flag && break_start.tv_sec > 0) {
 	    struct timeval now;
 	    gettimeofday(&now, NULL);
@@ -252,31 +512,19 @@ main(int argc, char *argv[])
 #endif
 	if (debug_flag)
 	    gettimeofday(&break_start, NULL);
-	if (0 == fork()) {
-	    dump_reports();
-	    _exit(0);
-	}
-	/* Parent quickly frees and clears its copy of the data so it can
-	   resume processing packets. */
-	freeArena();
-	dns_message_clear_arrays();
-
-	{
-	    /* Reap children. (Most recent probably has not exited yet, but
-	     * older ones should have.) */
-	    int cstatus = 0;
-	    pid_t pid;
-	    while ((pid = waitpid(0, &cstatus, WNOHANG)) > 0) {
-		if (WIFSIGNALED(cstatus))
-		    syslog(LOG_NOTICE, "child %d exited with signal %d",
-			pid, WTERMSIG(cstatus));
-		if (WIFEXITED(cstatus) && WEXITSTATUS(cstatus) != 0)
-		    syslog(LOG_NOTICE, "child %d exited with status %d",
-			pid, WEXITSTATUS(cstatus));
-	    }
-	}
-
+	/* The previous interval and its rollups must be written first;
+	   usually that was done long ago. */
+	writer_wait();
+	rollup_clear_due();
+	dns_message_rollup(interval_start_time(), interval_finish_time());
+	rollup_finish(interval_finish_time(), result <= 0 || debug_flag);
+	/* Freeze this interval's data and hand it to the writer, so
+	   packet processing can resume right away. */
+	s = interval_snapshot();
+	if (s)
+	    writer_hand_over(s);
     } while (result > 0 && debug_flag == 0);
+    writer_stop();
 
 #if HAVE_LIBNCAP
     Ncap_close();
@@ -4,6 +4,15 @@
 typedef struct {
     int min_count;	// min cell count to report
     int max_cells;	// max 2nd dim cells to print
+    int sparse;		// cell storage: 0 dense, 1 sparse, -1 automatic
+    int weight;		// what each message adds to its cell
+    int topk;		// Space-Saving counters per row, 0 for exact counts
+    int hll;		// HyperLogLog precision, 0 to count cells instead
+    int max_keys;	// indexer dictionary size limit, 0 for none
 } dataset_opt;
 
+/* values for dataset_opt.weight */
+#define DATASET_WEIGHT_COUNT	0	/* 1 per message */
+#define DATASET_WEIGHT_MSGLEN	1	/* DNS message length in bytes */
+
 #endif
@@ -0,0 +1,429 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "dataset_opt.h"
+#include "md_array.h"
+#include "hashtbl.h"
+#include "xmalloc.h"
+#include "delta.h"
+
+/*
+ * The delta printer sits in front of the output format's printer.  It
+ * keeps the counts last written for every cell of every array, takes
+ * in each array as it is printed, and hands the cells that need to be
+ * written on to the real printer when the array is finished.
+ *
+ * Everything here runs on the thread that writes the reports, and is
+ * malloc'ed, since it outlives the intervals' arenas.
+ */
+
+enum {
+    DELTA_OFF,
+    DELTA_CHANGED,
+    DELTA_CUMULATIVE
+};
+
+static int mode = DELTA_OFF;
+static int keyframe_every = 0;
+static int until_keyframe = 0;	/* files to write before the next keyframe */
+static int keyframe = 1;	/* the file being written is one */
+static unsigned int gen = 0;	/* counts files written */
+
+/* ==== STATE ============================================================= */
+
+typedef struct {
+    const char *d1;
+    const char *d2;
+    uint64_t count;		/* as last written */
+    unsigned int gen;		/* last seen in this file */
+    char labels[1];		/* d1 and d2, allocated to size */
+} delta_cell;
+
+typedef struct {
+    char *name;
+    hashtbl *cells;
+} delta_array;
+
+static hashtbl *arrays = NULL;	/* array name -> delta_array */
+
+static unsigned int
+cell_hashfunc(const void *key)
+{
+    const delta_cell *c = key;
+    return hashendian(c->d2, strlen(c->d2), hashendian(c->d1, strlen(c->d1), 0));
+}
+
+static int
+cell_cmpfunc(const void *a, const void *b)
+{
+    const delta_cell *x = a;
+    const delta_cell *y = b;
+    int r = strcmp(x->d1, y->d1);
+    return r ? r : strcmp(x->d2, y->d2);
+}
+
+static unsigned int
+name_hashfunc(const void *key)
+{
+    return hashendian(key, strlen(key), 0);
+}
+
+static int
+name_cmpfunc(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static void
+delta_array_free(void *p)
+{
+    delta_array *a = p;
+    if (a->cells)
+	hash_destroy(a->cells);
+    xfree(a->name);
+    xfree(a);
+}
+
+static delta_array *
+delta_array_find(const char *name)
+{
+    delta_array *a;
+    if (NULL == arrays) {
+	arrays = hash_create(64, name_hashfunc, name_cmpfunc, 0, NULL, delta_array_free);
+	if (NULL == arrays)
+	    return NULL;
+    }
+    if ((a = hash_find(name, arrays)))
+	return a;
+    if (NULL == (a = xcalloc(1, sizeof(*a))))
+	return NULL;
+    a->name = xstrdup(name);
+    a->cells = hash_create(1024, cell_hashfunc, cell_cmpfunc, 0, NULL, xfree);
+    if (NULL == a->name || NULL == a->cells || 0 != hash_add(a->name, a, arrays)) {
+	delta_array_free(a);
+	return NULL;
+    }
+    return a;
+}
+
+static delta_cell *
+delta_cell_find(delta_array *a, const char *d1, const char *d2)
+{
+    delta_cell key;
+    delta_cell *c;
+    size_t l1;
+    size_t l2;
+    key.d1 = d1;
+    key.d2 = d2;
+    if ((c = hash_find(&key, a->cells)))
+	return c;
+    l1 = strlen(d1);
+    l2 = strlen(d2);
+    if (NULL == (c = xmalloc(sizeof(*c) + l1 + l2 + 1)))
+	return NULL;
+    memcpy(c->labels, d1, l1 + 1);
+    memcpy(c->labels + l1 + 1, d2, l2 + 1);
+    c->d1 = c->labels;
+    c->d2 = c->labels + l1 + 1;
+    c->count = 0;
+    c->gen = 0;
+    if (0 != hash_add(c, c, a->cells)) {
+	xfree(c);
+	return NULL;
+    }
+    return c;
+}
+
+/* ==== OUTPUT ============================================================ */
+
+/*
+ * The cells to write for the current array, chained by row.  Labels
+ * point to the cells' state or to the labels being printed, which
+ * stay put until the array is finished.
+ */
+typedef struct {
+    const char *d1;
+    int first;
+    int last;
+} out_row;
+
+typedef struct {
+    const char *d2;
+    uint64_t count;
+    int next;
+} out_cell;
+
+static struct {
+    out_row *rows;
+    int nrows;
+    int rows_alloc;
+    out_cell *cells;
+    int ncells;
+    int cells_alloc;
+    hashtbl *index;		/* d1 -> row number + 1 */
+    int failed;
+} out;
+
+static void *
+out_grow(void *p, int *alloc, size_t size)
+{
+    int n = *alloc ? 2 * *alloc : 256;
+    void *q = xrealloc(p, n * size);
+    if (q)
+	*alloc = n;
+    return q;
+}
+
+static void
+out_cell_add(const char *d1, const char *d2, uint64_t count)
+{
+    intptr_t r;
+    if (out.failed)
+	return;
+    if (NULL == out.index)
+	out.index = hash_create(256, name_hashfunc, name_cmpfunc, 0, NULL, NULL);
+    if (NULL == out.index) {
+	out.failed = 1;
+	return;
+    }
+    if (0 == (r = (intptr_t) hash_find(d1, out.index))) {
+	if (out.nrows == out.rows_alloc) {
+	    out_row *rows = out_grow(out.rows, &out.rows_alloc, sizeof(*rows));
+	    if (NULL == rows) {
+		out.failed = 1;
+		return;
+	    }
+	    out.rows = rows;
+	}
+	out.rows[out.nrows].d1 = d1;
+	out.rows[out.nrows].first = -1;
+	out.rows[out.nrows].last = -1;
+	r = ++out.nrows;
+	if (0 != hash_add(d1, (void *) r, out.index)) {
+	    out.failed = 1;
+	    return;
+	}
+    }
+    if (out.ncells == out.cells_alloc) {
+	out_cell *cells = out_grow(out.cells, &out.cells_alloc, sizeof(*cells));
+	if (NULL == cells) {
+	    out.failed = 1;
+	    return;
+	}
+	out.cells = cells;
+    }
+    out.cells[out.ncells].d2 = d2;
+    out.cells[out.ncells].count = count;
+    out.cells[out.ncells].next = -1;
+    if (out.rows[r - 1].last < 0)
+	out.rows[r - 1].first = out.ncells;
+    else
+	out.cells[out.rows[r - 1].last].next = out.ncells;
+    out.rows[r - 1].last = out.ncells;
+    out.ncells++;
+}
+
+/* ==== PRINTER =========================================================== */
+
+static md_array_printer *inner = NULL;
+static void *inner_data;
+static delta_array *cur;
+static const char *cur_name;
+static const char *d1_type_s;
+static const char *d2_type_s;
+static const char *cur_d1;
+
+static void
+start_array(void *pr_data, const char *name)
+{
+    inner_data = pr_data;
+    cur_name = name;
+    out.nrows = 0;
+    out.ncells = 0;
+    out.failed = 0;
+    if (NULL == (cur = delta_array_find(name)))
+	delta_failed();
+}
+
+static void
+d1_type(void *pr_data, const char *t)
+{
+    d1_type_s = t;
+}
+
+static void
+d2_type(void *pr_data, const char *t)
+{
+    d2_type_s = t;
+}
+
+static void
+start_data(void *pr_data)
+{
+}
+
+static void
+finish_data(void *pr_data)
+{
+}
+
+static void
+d1_begin(void *pr_data, char *l)
+{
+    cur_d1 = l;
+}
+
+static void
+d1_end(void *pr_data, char *l)
+{
+}
+
+static void
+print_element(void *pr_data, char *l, uint64_t val)
+{
+    delta_cell *c = cur ? delta_cell_find(cur, cur_d1, l) : NULL;
+    if (NULL == c) {
+	/* written as it is; the next file is a keyframe */
+	delta_failed();
+	out_cell_add(cur_d1, l, val);
+	return;
+    }
+    c->gen = gen;
+    if (DELTA_CHANGED == mode) {
+	if (keyframe || c->count != val)
+	    out_cell_add(c->d1, c->d2, val);
+	c->count = val;
+    } else {
+	c->count += val;
+	if (keyframe || val)
+	    out_cell_add(c->d1, c->d2, c->count);
+    }
+}
+
+static void
+finish_array(void *pr_data)
+{
+    delta_cell *c;
+    int r;
+    int i;
+    /*
+     * Cells that are gone are written once with a count of 0, and
+     * forgotten once the array has been printed.
+     */
+    if (DELTA_CHANGED == mode && cur) {
+	hash_iter_init(cur->cells);
+	while ((c = hash_iterate(cur->cells)))
+	    if (c->gen != gen && c->count) {
+		out_cell_add(c->d1, c->d2, 0);
+		c->count = 0;
+	    }
+    }
+    if (out.failed) {
+	syslog(LOG_CRIT, "%s", "Cant output delta array due to malloc failure!");
+	delta_failed();
+    } else {
+	inner->start_array(inner_data, cur_name);
+	inner->d1_type(inner_data, d1_type_s);
+	inner->d2_type(inner_data, d2_type_s);
+	inner->start_data(inner_data);
+	for (r = 0; r < out.nrows; r++) {
+	    inner->d1_begin(inner_data, (char *) out.rows[r].d1);
+	    for (i = out.rows[r].first; i >= 0; i = out.cells[i].next)
+		inner->print_element(inner_data, (char *) out.cells[i].d2, out.cells[i].count);
+	    inner->d1_end(inner_data, (char *) out.rows[r].d1);
+	}
+	inner->finish_data(inner_data);
+	inner->finish_array(inner_data);
+    }
+    if (out.index)
+	hash_destroy(out.index);
+    out.index = NULL;
+    if (DELTA_CHANGED == mode && cur) {
+	hash_iter_init(cur->cells);
+	while ((c = hash_iterate(cur->cells)))
+	    if (c->gen != gen)
+		hash_remove(c, cur->cells);
+    }
+}
+
+static md_array_printer delta_wrapper =
+{
+    start_array,
+    finish_array,
+    d1_type,
+    d2_type,
+    start_data,
+    finish_data,
+    d1_begin,
+    d1_end,
+    print_element
+};
+
+/* ==== INTERFACE ========================================================= */
+
+int
+delta_set_mode(const char *m, int every)
+{
+    if (0 == strcmp(m, "changed"))
+	mode = DELTA_CHANGED;
+    else if (0 == strcmp(m, "cumulative"))
+	mode = DELTA_CUMULATIVE;
+    else {
+	syslog(LOG_ERR, "unknown output_delta mode '%s'", m);
+	return 0;
+    }
+    if (every < 1) {
+	syslog(LOG_ERR, "output_delta keyframe interval must be at least 1");
+	return 0;
+    }
+    keyframe_every = every;
+    return 1;
+}
+
+/*
+ * Called before each interval file is written.  Returns what goes
+ * after "dscdata" in its name.
+ */
+const char *
+delta_begin(void)
+{
+    if (DELTA_OFF == mode)
+	return "";
+    gen++;
+    keyframe = until_keyframe <= 0;
+    if (keyframe) {
+	if (arrays)
+	    hash_destroy(arrays);
+	arrays = NULL;
+	until_keyframe = keyframe_every;
+    }
+    until_keyframe--;
+    if (keyframe)
+	return "";
+    return DELTA_CHANGED == mode ? "_delta" : "_cumulative";
+}
+
+/*
+ * The last file was not written (or not completely), so the next one
+ * cannot build on it.
+ */
+void
+delta_failed(void)
+{
+    until_keyframe = 0;
+}
+
+md_array_printer *
+delta_printer(md_array_printer *pr)
+{
+    if (DELTA_OFF == mode)
+	return pr;
+    inner = pr;
+    return &delta_wrapper;
+}
@@ -0,0 +1,30 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+/*
+ * Delta output (output_delta).  Every Nth interval file is a full
+ * keyframe; the ones in between only have the cells that changed.
+ *
+ * With "changed", a cell is written when its count differs from the
+ * previous interval's, and with a count of 0 when it is gone.  The
+ * counts of an interval are those of the one before, with the file's
+ * cells replacing them and cells with count 0 dropped.
+ *
+ * With "cumulative", counts are running totals since the keyframe,
+ * and a cell is written when its total grew.  An interval's count is
+ * the difference between the cell's total in its file and the last
+ * total written before that (0 if it is not in the file).
+ *
+ * Keyframes are named as usual, <time>.dscdata.xml; the files in
+ * between are <time>.dscdata_delta.xml or <time>.dscdata_cumulative.xml.
+ * Rollup files are always complete.
+ */
+
+struct _md_array_printer;
+
+int delta_set_mode(const char *mode, int keyframe_every);
+const char *delta_begin(void);
+void delta_failed(void);
+struct _md_array_printer *delta_printer(struct _md_array_printer *);
+
+#endif /* DELTA_H */
@@ -19,6 +19,10 @@
 #include "xmalloc.h"
 #include "dns_message.h"
 #include "md_array.h"
+#include "hll.h"
+#include "rollup.h"
+#include "snapshot.h"
+#include "live.h"
 #include "null_index.h"
 #include "qtype_index.h"
 #include "qclass_index.h"
@@ -31,6 +35,7 @@
 #include "client_ipv4_net_index.h"
 #include "qnamelen_index.h"
 #include "qname_index.h"
+#include "qname_cms_index.h"
 #include "msglen_index.h"
 #include "certain_qnames_index.h"
 #include "idn_qname_index.h"
@@ -52,7 +57,6 @@
 
 #include "syslog_debug.h"
 
-extern md_array_printer xml_printer;
 extern int debug_flag;
 static md_array_list *Arrays = NULL;
 static filter_list *DNSFilters = NULL;
@@ -106,6 +110,8 @@ dns_message_handle(dns_message * m)
     md_array_list *a;
     if (debug_flag > 1)
 	dns_message_print(m);
+    md_array_new_message();
+    live_message(m);
     for (a = Arrays; a; a = a->next)
 	md_array_count(a->theArray, m);
 }
@@ -200,24 +206,34 @@ qname_filter(const void *vp, const void *ctx)
     return (0 == regexec(r, m->qname, 0, NULL, 0));
 }
 
+static unsigned int
+msglen_weight(const void *vp)
+{
+    const dns_message *m = vp;
+    return m->msglen;
+}
+
 static indexer_t indexers[] = {
-    { "client",               cip_indexer,                  cip_iterator,                  cip_reset },
-    { "cip4_addr",            cip_indexer,                  cip_iterator,                  cip_reset },     /* compatibility */
+    { "client",               cip_indexer,                  cip_iterator,                  cip_reset, cip_hasher, cip_stats, cip_max_keys },
+    { "cip4_addr",            cip_indexer,                  cip_iterator,                  cip_reset, cip_hasher, cip_stats, cip_max_keys },     /* compatibility */
 #if HAVE_LIBGEOIP
-    { "country",                  country_indexer,                  country_iterator,                  country_reset },
+    { "country",                  country_indexer,                  country_iterator,                  country_reset, NULL, country_stats, country_max_keys },
 #endif
-    { "client_subnet",        cip_net_indexer,              cip_net_iterator,              cip_net_reset },
-    { "cip4_net",             cip_net_indexer,              cip_net_iterator,              cip_net_reset }, /* compatibility */
+    { "client_subnet",        cip_net_indexer,              cip_net_iterator,              cip_net_reset, cip_net_hasher, cip_net_stats, cip_net_max_keys },
+    { "cip4_net",             cip_net_indexer,              cip_net_iterator,              cip_net_reset, cip_net_hasher, cip_net_stats, cip_net_max_keys }, /* compatibility */
     { "null",                 null_indexer,                 null_iterator,                 NULL },
     { "qclass",               qclass_indexer,               qclass_iterator,               qclass_reset },
     { "qnamelen",             qnamelen_indexer,             qnamelen_iterator,             qnamelen_reset },
-    { "qname",                qname_indexer,                qname_iterator,                qname_reset },
-    { "second_ld",            second_ld_indexer,            second_ld_iterator,            second_ld_reset },
-    { "third_ld",             third_ld_indexer,             third_ld_iterator,             third_ld_reset },
+    { "qname",                qname_indexer,                qname_iterator,                qname_reset, qname_hasher, qname_stats, qname_max_keys },
+    { "second_ld",            second_ld_indexer,            second_ld_iterator,            second_ld_reset, second_ld_hasher, second_ld_stats, second_ld_max_keys },
+    { "third_ld",             third_ld_indexer,             third_ld_iterator,             third_ld_reset, third_ld_hasher, third_ld_stats, third_ld_max_keys },
+    { "qname_cms",            qname_cms_indexer,            qname_cms_iterator,            qname_cms_reset, NULL, qname_cms_stats },
+    { "second_ld_cms",        second_ld_cms_indexer,        second_ld_cms_iterator,        second_ld_cms_reset, NULL, second_ld_cms_stats },
+    { "third_ld_cms",         third_ld_cms_indexer,         third_ld_cms_iterator,         third_ld_cms_reset, NULL, third_ld_cms_stats },
     { "msglen",               msglen_indexer,               msglen_iterator,               msglen_reset },
     { "qtype",                qtype_indexer,                qtype_iterator,                qtype_reset },
     { "rcode",                rcode_indexer,                rcode_iterator,                rcode_reset },
-    { "tld",                  tld_indexer,                  tld_iterator,                  tld_reset },
+    { "tld",                  tld_indexer,                  tld_iterator,                  tld_reset, tld_hasher, tld_stats, tld_max_keys },
     { "certain_qnames",       certain_qnames_indexer,       certain_qnames_iterator,       NULL },
     { "query_classification", query_classification_indexer, query_classification_iterator, NULL },
     { "idn_qname",            idn_qname_indexer,            idn_qname_iterator,            NULL },
@@ -316,6 +332,28 @@ dns_message_add_array(const char *name, const char *fn, const char *fi,
 	return 0;
     if (0 == dns_message_find_filters(f, &filters))
 	return 0;
+    if (opts.max_keys) {
+	if (NULL == indexer1->limit_fn && NULL == indexer2->limit_fn) {
+	    syslog(LOG_ERR, "max-keys can't be used with indexers '%s' and '%s'",
+		fi, si);
+	    return 0;
+	}
+	if (indexer1->limit_fn)
+	    indexer1->limit_fn(opts.max_keys);
+	if (indexer2->limit_fn)
+	    indexer2->limit_fn(opts.max_keys);
+    }
+    if (opts.hll) {
+	if (NULL == indexer2->hash_fn) {
+	    syslog(LOG_ERR, "indexer '%s' can't be used with hll", si);
+	    return 0;
+	}
+	if (opts.hll < HLL_MIN_PRECISION || opts.hll > HLL_MAX_PRECISION) {
+	    syslog(LOG_ERR, "hll precision must be between %d and %d",
+		HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+	    return 0;
+	}
+    }
 
     a = xcalloc(1, sizeof(*a));
     if (a == NULL) {
@@ -329,24 +367,98 @@ dns_message_add_array(const char *name, const char *fn, const char *fi,
 	return 0;
     }
     a->theArray->opts = opts;
+    if (DATASET_WEIGHT_MSGLEN == opts.weight)
+	a->theArray->weight_fn = msglen_weight;
     assert(a->theArray);
     a->next = Arrays;
     Arrays = a;
     return 1;
 }
 
+/*
+ * Indexers that estimate rather than count (e.g. qname_cms) report
+ * their error bounds in an extra "indexer_stats" array.
+ */
+static void
+dns_message_report_indexer_stats(md_array_printer *pr, FILE *fp)
+{
+    indexer_t *indexer;
+    char *label;
+    uint64_t val;
+    int started = 0;
+    for (indexer = indexers; indexer->name; indexer++) {
+	if (NULL == indexer->stats_fn || 0 == indexer->memo.misses)
+	    continue;
+	if (!started) {
+	    pr->start_array(fp, "indexer_stats");
+	    pr->d1_type(fp, "Indexer");
+	    pr->d2_type(fp, "Statistic");
+	    pr->start_data(fp);
+	    started = 1;
+	}
+	pr->d1_begin(fp, (char *) indexer->name);
+	indexer->stats_fn(NULL, NULL);
+	while (indexer->stats_fn(&label, &val) > -1)
+	    pr->print_element(fp, label, val);
+	pr->d1_end(fp, (char *) indexer->name);
+    }
+    if (started) {
+	pr->finish_data(fp);
+	pr->finish_array(fp);
+    }
+}
+
+/*
+ * Freezes this interval's arrays, before they are cleared.
+ */
+void
+dns_message_snapshot(snapshot *s)
+{
+    md_array_list *a;
+    for (a = Arrays; a; a = a->next)
+	snapshot_add_array(s, a->theArray);
+    dns_message_report_indexer_stats(&snapshot_recorder, NULL);
+}
+
+/*
+ * Adds this interval's arrays to the rollups, before they are cleared.
+ */
 void
-dns_message_report(FILE *fp)
+dns_message_rollup(int start, int finish)
 {
     md_array_list *a;
     for (a = Arrays; a; a = a->next)
-	md_array_print(a->theArray, &xml_printer, fp);
+	rollup_fold(a->theArray, start, finish);
+}
+
+void
+dns_message_report_rollup(md_array_printer *pr, FILE *fp, rollup_level *l)
+{
+    rollup_report(l, pr, fp);
+}
+
+static void
+dns_message_indexer_stats(void)
+{
+    indexer_t *indexer;
+    for (indexer = indexers; indexer->name; indexer++) {
+	unsigned int calls = indexer->memo.hits + indexer->memo.misses;
+	if (0 == calls)
+	    continue;
+	if (debug_flag)
+	    syslog(LOG_INFO, "indexer %s: %u lookups, %u memo hits (%u%%)",
+		indexer->name, calls, indexer->memo.hits,
+		(unsigned int) (100.0 * indexer->memo.hits / calls));
+	indexer->memo.hits = 0;
+	indexer->memo.misses = 0;
+    }
 }
 
 void
 dns_message_clear_arrays(void)
 {
     md_array_list *a;
+    dns_message_indexer_stats();
     for (a = Arrays; a; a = a->next)
 	md_array_clear(a->theArray);
 }
@@ -47,12 +47,18 @@ struct _dns_message {
 
 typedef void (DMC) (dns_message *);
 
-void dns_message_report(FILE *);
 int dns_message_add_array(const char *, const char *,const char *,const char *,const char *,const char *, dataset_opt);
 const char * dns_message_QnameToNld(const char *, int);
 const char * dns_message_tld(dns_message * m);
 void dns_message_init(void);
 void dns_message_clear_arrays(void);
+void dns_message_rollup(int start, int finish);
+struct _snapshot;
+void dns_message_snapshot(struct _snapshot *);
+struct _rollup_level;
+struct _md_array_printer;
+void dns_message_report_rollup(struct _md_array_printer *, FILE *,
+    struct _rollup_level *);
 
 #ifndef T_OPT
 #define T_OPT 41	/* OPT pseudo-RR, RFC2761 */
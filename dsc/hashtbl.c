@@ -1,28 +1,203 @@
 #include "config.h"
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #if HAVE_STDINT_H
 #include <stdint.h>
 #endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "xmalloc.h"
 #include "hashtbl.h"
 
+#define GROUP 16		/* control bytes compared at once */
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE	/* full slots have the high bit clear */
+#define MAX_INITIAL 1024	/* entries; larger tables grow into it */
+
+/*
+ * Entries are allocated up to 7/8 of the slots, so every probe
+ * sequence runs into an empty slot.
+ */
+#define MAX_ENTRIES(size) ((size) / 8 * 7)
+
+/*
+ * The hashers are not all equally good (some just add up bytes), so
+ * their results are mixed (MurmurHash3's finalizer) before use.
+ */
+static unsigned int
+hash_mix(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+#define CTRL_TAG(h) ((h) >> 25)
+
+/*
+ * Bit i of the result is set if control byte i of the group matches.
+ */
+static unsigned int
+group_match(const unsigned char *g, unsigned char tag)
+{
+#if defined(__SSE2__)
+	__m128i ctrl = _mm_loadu_si128((const __m128i *) g);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+#else
+	unsigned int m = 0;
+	int i;
+	for (i = 0; i < GROUP; i++)
+		if (g[i] == tag)
+			m |= 1 << i;
+	return m;
+#endif
+}
+
+/*
+ * Empty or deleted slots.
+ */
+static unsigned int
+group_match_free(const unsigned char *g)
+{
+#if defined(__SSE2__)
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) g));
+#else
+	unsigned int m = 0;
+	int i;
+	for (i = 0; i < GROUP; i++)
+		if (g[i] & 0x80)
+			m |= 1 << i;
+	return m;
+#endif
+}
+
+static int
+lowest_bit(unsigned int m)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(m);
+#else
+	int b = 0;
+	while (0 == (m & 1)) {
+		m >>= 1;
+		b++;
+	}
+	return b;
+#endif
+}
+
+/*
+ * Groups are probed triangularly (start, +1, +3, +6, ... groups),
+ * which visits every group since their number is a power of two.
+ */
+#define PROBE_START(h, size) ((h) & ((size) - 1) & ~(GROUP - 1))
+#define PROBE_NEXT(pos, step, size) (((pos) + (step)) & ((size) - 1))
+
+static unsigned int
+hash_find_free(const unsigned char *ctrl, unsigned int size, unsigned int h)
+{
+	unsigned int pos = PROBE_START(h, size);
+	unsigned int step = 0;
+	unsigned int m;
+	while (0 == (m = group_match_free(ctrl + pos))) {
+		step += GROUP;
+		pos = PROBE_NEXT(pos, step, size);
+	}
+	return pos + lowest_bit(m);
+}
+
+static int
+hash_find_slot(const void *key, unsigned int h, hashtbl *tbl)
+{
+	unsigned int pos = PROBE_START(h, tbl->size);
+	unsigned int step = 0;
+	for (;;) {
+		const unsigned char *g = tbl->ctrl + pos;
+		unsigned int m = group_match(g, CTRL_TAG(h));
+		while (m) {
+			int b = lowest_bit(m);
+			hashitem *i = &tbl->items[tbl->slots[pos + b]];
+			if (i->hash == h && 0 == tbl->keycmp(key, i->key))
+				return pos + b;
+			m &= m - 1;
+		}
+		if (group_match(g, CTRL_EMPTY))
+			return -1;
+		step += GROUP;
+		pos = PROBE_NEXT(pos, step, tbl->size);
+	}
+}
+
+/*
+ * Rebuilds the table with 'size' slots, dropping removed entries but
+ * keeping the others in order.
+ */
+static int
+hash_resize(hashtbl *tbl, unsigned int size)
+{
+	void *(*alloc)(size_t, size_t) = tbl->use_arena ? acalloc : xcalloc;
+	unsigned char *ctrl = alloc(size, 1);
+	unsigned int *slots = alloc(size, sizeof(*slots));
+	hashitem *items = alloc(MAX_ENTRIES(size), sizeof(*items));
+	unsigned int i;
+	unsigned int n = 0;
+	if (NULL == ctrl || NULL == slots || NULL == items) {
+		if (!tbl->use_arena) {
+			xfree(ctrl);
+			xfree(slots);
+			xfree(items);
+		}
+		return 0;
+	}
+	memset(ctrl, CTRL_EMPTY, size);
+	for (i = 0; i < tbl->used; i++) {
+		unsigned int s;
+		if (NULL == tbl->items[i].key)
+			continue;
+		items[n] = tbl->items[i];
+		s = hash_find_free(ctrl, size, items[n].hash);
+		ctrl[s] = CTRL_TAG(items[n].hash);
+		slots[s] = n++;
+	}
+	if (!tbl->use_arena) {
+		xfree(tbl->ctrl);
+		xfree(tbl->slots);
+		xfree(tbl->items);
+	}
+	tbl->size = size;
+	tbl->ctrl = ctrl;
+	tbl->slots = slots;
+	tbl->items = items;
+	tbl->alloc = MAX_ENTRIES(size);
+	tbl->used = tbl->count = n;
+	tbl->iter.next = 0;
+	return 1;
+}
+
 hashtbl
 *hash_create(int N, hashfunc *hasher, hashkeycmp *cmp, int use_arena,
     hashfree *keyfree, hashfree *datafree)
 {
 	hashtbl *new = (*(use_arena ? acalloc : xcalloc))(1, sizeof(*new));
+	unsigned int size = GROUP;
 	if (NULL == new)
 	    return NULL;
-	new->modulus = N;
 	new->hasher = hasher;
 	new->keycmp = cmp;
 	new->use_arena = use_arena;
 	new->keyfree = keyfree;
 	new->datafree = datafree;
-	new->items = (*(use_arena ? acalloc : xcalloc))(N, sizeof(hashitem*));
-	if (NULL == new->items) {
+	if (N > MAX_INITIAL)
+	    N = MAX_INITIAL;
+	while (MAX_ENTRIES(size) < N)
+	    size <<= 1;
+	if (!hash_resize(new, size)) {
 		if (!use_arena)
 		    xfree(new);
 		return NULL;
@@ -33,100 +208,111 @@ hashtbl
 void
 hash_destroy(hashtbl *tbl)
 {
-    hashitem *i, *next;
-    int slot;
-    for (slot = 0; slot < tbl->modulus; slot++) {
-	for (i = tbl->items[slot]; i; i = next) {
-	    next = i->next;
-	    if (tbl->keyfree)
-		tbl->keyfree((void *)i->key);
-	    if (tbl->datafree)
-		tbl->datafree(i->data);
-	    if (!tbl->use_arena)
-		xfree(i);
-	}
+    unsigned int n;
+    for (n = 0; n < tbl->used; n++) {
+	hashitem *i = &tbl->items[n];
+	if (NULL == i->key)
+	    continue;
+	if (tbl->keyfree)
+	    tbl->keyfree((void *)i->key);
+	if (tbl->datafree)
+	    tbl->datafree(i->data);
     }
-    if (!tbl->use_arena)
+    if (!tbl->use_arena) {
+	xfree(tbl->ctrl);
+	xfree(tbl->slots);
+	xfree(tbl->items);
 	xfree(tbl);
+    }
 }
 
 int
 hash_add(const void *key, void *data, hashtbl *tbl)
 {
-	hashitem *new = (*(tbl->use_arena ? acalloc : xcalloc))(1,sizeof(*new));
-	hashitem **I;
-	int slot;
-	if (NULL == new)
-	    return 1;
-	new->key = key;
-	new->data = data;
-	slot = tbl->hasher(key) % tbl->modulus;
-	for (I = &tbl->items[slot]; *I; I = &(*I)->next);
-	*I = new;
+	return hash_add_hashed(key, tbl->hasher(key), data, tbl);
+}
+
+/*
+ * For callers that already know hasher(key).
+ */
+int
+hash_add_hashed(const void *key, unsigned int hash, void *data, hashtbl *tbl)
+{
+	unsigned int h = hash_mix(hash);
+	unsigned int s;
+	if (tbl->used == tbl->alloc) {
+		/* leave the rebuilt table at most half full */
+		unsigned int size = tbl->size;
+		while (MAX_ENTRIES(size) < 2 * (tbl->count + 1))
+			size <<= 1;
+		if (!hash_resize(tbl, size))
+			return 1;
+	}
+	s = hash_find_free(tbl->ctrl, tbl->size, h);
+	tbl->ctrl[s] = CTRL_TAG(h);
+	tbl->slots[s] = tbl->used;
+	tbl->items[tbl->used].key = key;
+	tbl->items[tbl->used].data = data;
+	tbl->items[tbl->used].hash = h;
+	tbl->used++;
+	tbl->count++;
 	return 0;
 }
 
+/*
+ * Removed entries keep their place in the entries array until the
+ * next rebuild, so it is safe to remove while iterating.
+ */
 void
 hash_remove(const void *key, hashtbl *tbl)
 {
-	hashitem **I, *i;
-	int slot;
-	slot = tbl->hasher(key) % tbl->modulus;
-	for (I = &tbl->items[slot]; *I; I = &(*I)->next) {
-	    if (0 == tbl->keycmp(key, (*I)->key)) {
-		i = *I;
-		*I = (*I)->next;
-		if (tbl->keyfree)
-		    tbl->keyfree((void *)i->key);
-		if (tbl->datafree)
-		    tbl->datafree(i->data);
-		if (!tbl->use_arena)
-		    xfree(i);
-		break;
-	    }
-	}
+	int s = hash_find_slot(key, hash_mix(tbl->hasher(key)), tbl);
+	hashitem *i;
+	if (s < 0)
+		return;
+	i = &tbl->items[tbl->slots[s]];
+	if (tbl->keyfree)
+		tbl->keyfree((void *)i->key);
+	if (tbl->datafree)
+		tbl->datafree(i->data);
+	i->key = NULL;
+	i->data = NULL;
+	/* lookups stop at a group with an empty slot anyway */
+	if (group_match(tbl->ctrl + (s & ~(GROUP - 1)), CTRL_EMPTY))
+		tbl->ctrl[s] = CTRL_EMPTY;
+	else
+		tbl->ctrl[s] = CTRL_DELETED;
+	tbl->count--;
 }
 
 void *
 hash_find(const void *key, hashtbl *tbl)
 {
-	int slot = tbl->hasher(key) % tbl->modulus;
-	hashitem *i;
-	for (i = tbl->items[slot]; i; i = i->next) {
-		if (0 == tbl->keycmp(key, i->key))
-		    return i->data;
-	}
-	return NULL;
+	return hash_find_hashed(key, tbl->hasher(key), tbl);
 }
 
-static void
-hash_iter_next_slot(hashtbl *tbl)
+void *
+hash_find_hashed(const void *key, unsigned int hash, hashtbl *tbl)
 {
-	while (tbl->iter.next == NULL) {
-		tbl->iter.slot++;
-		if (tbl->iter.slot == tbl->modulus)
-			break;
-		tbl->iter.next = tbl->items[tbl->iter.slot];
-	}
+	int s = hash_find_slot(key, hash_mix(hash), tbl);
+	if (s < 0)
+		return NULL;
+	return tbl->items[tbl->slots[s]].data;
 }
 
 void
 hash_iter_init(hashtbl *tbl)
 {
-	tbl->iter.slot = 0;
-	tbl->iter.next = tbl->items[tbl->iter.slot];
-	if (NULL == tbl->iter.next)
-		hash_iter_next_slot(tbl);
+	tbl->iter.next = 0;
 }
 
 void *
 hash_iterate(hashtbl *tbl)
 {
-	hashitem *this = tbl->iter.next;
-	if (this) {
-		tbl->iter.next = this->next;
-		if (NULL == tbl->iter.next)
-			hash_iter_next_slot(tbl);
+	while (tbl->iter.next < tbl->used) {
+		hashitem *this = &tbl->items[tbl->iter.next++];
+		if (this->key)
+			return this->data;
 	}
-	return this ? this->data : NULL;
+	return NULL;
 }
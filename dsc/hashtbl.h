@@ -1,8 +1,22 @@
 
+/*
+ * Open addressing hash table with SwissTable style control bytes.
+ *
+ * Each slot has a control byte that is either EMPTY, DELETED, or the
+ * top 7 bits of the key's hash.  Lookups compare a whole group of
+ * control bytes at once (with SSE2 where available) and only call
+ * keycmp on entries whose full stored hash matches.  The slots refer
+ * to a dense array of entries kept in insertion order, which is also
+ * the iteration order, so indexer labels come out in a stable order.
+ *
+ * The table grows as needed; N only sizes the initial table.  Tables
+ * live in the arena or are malloc'ed, as chosen by use_arena.
+ */
+
 typedef struct _hashitem {
-	const void *key;
+	const void *key;	/* NULL once removed */
 	void *data;
-	struct _hashitem *next;
+	unsigned int hash;
 } hashitem;
 
 typedef unsigned int hashfunc(const void *key);
@@ -10,19 +24,28 @@ typedef int hashkeycmp(const void *a, const void *b);
 typedef void hashfree(void *p);
 
 typedef struct {
-	unsigned int modulus;
-	hashitem **items;
+	unsigned int size;	/* slots, a power of two */
+	unsigned char *ctrl;
+	unsigned int *slots;	/* slot -> entry number */
+	hashitem *items;	/* entries in insertion order */
+	unsigned int alloc;	/* entries allocated */
+	unsigned int used;	/* entries used, including removed ones */
+	unsigned int count;	/* live entries */
 	hashfunc *hasher;
 	hashkeycmp *keycmp;
 	int use_arena;
 	hashfree *keyfree;
 	hashfree *datafree;
 	struct {
-		hashitem *next;
-		unsigned int slot;
+		unsigned int next;
 	} iter;
 } hashtbl;
 
+/*
+ * Approximate memory used per key: its entry plus its share of the
+ * slots and control bytes (about two slots per key).
+ */
+#define HASH_ITEM_BYTES (sizeof(hashitem) + 2 * (1 + sizeof(unsigned int)))
 
 hashtbl *hash_create(int N, hashfunc *, hashkeycmp *, int use_arena,
     hashfree *, hashfree *);
@@ -30,6 +53,8 @@ void hash_destroy(hashtbl *);
 int hash_add(const void *key, void *data, hashtbl *);
 void hash_remove(const void *key, hashtbl *tbl);
 void *hash_find(const void *key, hashtbl *);
+int hash_add_hashed(const void *key, unsigned int hash, void *data, hashtbl *);
+void *hash_find_hashed(const void *key, unsigned int hash, hashtbl *);
 void hash_iter_init(hashtbl *);
 void *hash_iterate(hashtbl *);
 
@@ -40,6 +65,7 @@ void *hash_iterate(hashtbl *);
 extern uint32_t hashlittle(const void *key, size_t length, uint32_t initval);
 extern uint32_t hashbig(const void *key, size_t length, uint32_t initval);
 extern uint32_t hashword(const uint32_t *k, size_t length, uint32_t initval);
+extern void hashlittle2(const void *key, size_t length, uint32_t *pc, uint32_t *pb);
 
 #ifndef BYTE_ORDER
 #define hashendian hashlittle
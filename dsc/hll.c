@@ -0,0 +1,134 @@
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xmalloc.h"
+#include "hashtbl.h"
+#include "hll.h"
+
+/*
+ * Registers are written as one character each.  Register values never
+ * exceed 64 - p + 1, so 64 characters are enough, and these 64 are
+ * ones the XML printer emits without base64 encoding.
+ */
+static const char *hll_digits = "0123456789"
+"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz._";
+
+hll *
+hll_create(unsigned int p)
+{
+    hll *h;
+    if (p < HLL_MIN_PRECISION || p > HLL_MAX_PRECISION)
+	return NULL;
+    h = acalloc(1, sizeof(*h));
+    if (NULL == h)
+	return NULL;
+    h->p = p;
+    h->reg = acalloc(1 << p, sizeof(*h->reg));
+    if (NULL == h->reg)
+	return NULL;
+    return h;
+}
+
+/*
+ * The top 'p' bits of the hash choose a register; the register keeps
+ * the largest position of the first 1 bit seen in the remaining bits.
+ */
+void
+hll_add(hll *h, uint64_t hash)
+{
+    unsigned int i = hash >> (64 - h->p);
+    uint64_t w = hash << h->p;
+    unsigned char rank = 1;
+    while (rank <= 64 - h->p && 0 == (w & ((uint64_t) 1 << 63))) {
+	rank++;
+	w <<= 1;
+    }
+    if (rank > h->reg[i])
+	h->reg[i] = rank;
+}
+
+int
+hll_merge(hll *dst, const hll *src)
+{
+    unsigned int i;
+    if (dst->p != src->p)
+	return 0;
+    for (i = 0; i < (1U << dst->p); i++)
+	if (src->reg[i] > dst->reg[i])
+	    dst->reg[i] = src->reg[i];
+    return 1;
+}
+
+double
+hll_estimate(const hll *h)
+{
+    unsigned int m = 1 << h->p;
+    unsigned int zeros = 0;
+    unsigned int i;
+    double sum = 0.0;
+    double alpha;
+    double e;
+    switch (m) {
+    case 16:
+	alpha = 0.673;
+	break;
+    case 32:
+	alpha = 0.697;
+	break;
+    case 64:
+	alpha = 0.709;
+	break;
+    default:
+	alpha = 0.7213 / (1.0 + 1.079 / m);
+	break;
+    }
+    for (i = 0; i < m; i++) {
+	sum += ldexp(1.0, -(int) h->reg[i]);
+	if (0 == h->reg[i])
+	    zeros++;
+    }
+    e = alpha * m * m / sum;
+    /* small range correction */
+    if (e <= 2.5 * m && zeros)
+	e = m * log((double) m / zeros);
+    return e;
+}
+
+/*
+ * One standard error of the estimate.
+ */
+double
+hll_error(const hll *h)
+{
+    return 1.04 / sqrt((double) (1 << h->p)) * hll_estimate(h);
+}
+
+int
+hll_encode(const hll *h, char *buf, size_t len)
+{
+    unsigned int i;
+    if (len < HLL_ENCODED_SZ(h->p))
+	return 0;
+    for (i = 0; i < (1U << h->p); i++)
+	buf[i] = hll_digits[h->reg[i]];
+    buf[i] = '\0';
+    return 1;
+}
+
+/*
+ * 64 bit hash for hll_add().  hashlittle2() gives the same result on
+ * any byte order, so sketches from different hosts can be merged.
+ */
+uint64_t
+hll_hash(const void *key, size_t len)
+{
+    uint32_t pc = 0;
+    uint32_t pb = 0;
+    hashlittle2(key, len, &pc, &pb);
+    return ((uint64_t) pc << 32) | pb;
+}
@@ -0,0 +1,41 @@
+#ifndef HLL_H
+#define HLL_H
+
+#include "config.h"
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+/*
+ * HyperLogLog distinct value counter (Flajolet et al., with the
+ * linear counting correction for small cardinalities).
+ *
+ * A sketch of precision 'p' has 2^p one-byte registers and estimates
+ * the number of distinct hashes added with a standard error of about
+ * 1.04/sqrt(2^p).  Sketches of the same precision can be merged by
+ * taking the larger of each pair of registers; rollups combine the
+ * sketches of several intervals that way.  The registers are written
+ * out with the estimate (hll_encode()), for whatever reads the data
+ * files to combine sketches from several collectors.
+ */
+
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 16
+
+typedef struct _hll {
+    unsigned int p;
+    unsigned char *reg;
+} hll;
+
+hll *hll_create(unsigned int p);
+void hll_add(hll *, uint64_t hash);
+int hll_merge(hll *dst, const hll *src);
+double hll_estimate(const hll *);
+double hll_error(const hll *);
+int hll_encode(const hll *, char *buf, size_t len);
+uint64_t hll_hash(const void *key, size_t len);
+
+/* encoded size including the terminating NUL */
+#define HLL_ENCODED_SZ(p) ((1U << (p)) + 1)
+
+#endif /* HLL_H */
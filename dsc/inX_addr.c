@@ -5,6 +5,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "inX_addr.h"
 
@@ -45,11 +46,37 @@ inXaddr_pton(const char *buf, inX_addr *a)
 	return inet_pton(AF_INET, buf, &a->_.in4);
 }
 
+/*
+ * Hashes all 128 bits (multiply-xorshift over two 64 bit words), so
+ * that addresses differing only in their upper bits, such as masked
+ * IPv6 prefixes, do not collide.
+ */
 unsigned int
 inXaddr_hash(const inX_addr *a)
 {
-	/* just ignore the upper bits for v6? */
-	return ntohl(a->_.in4.s_addr);
+#if USE_IPV6
+	uint64_t w[2];
+	uint64_t h;
+	memcpy(w, a, sizeof(w));
+	h = w[0] * 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 29;
+	h += w[1];
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return (unsigned int) h;
+#else
+	return a->_.in4.s_addr * 0x9e3779b1U;
+#endif
+}
+
+/*
+ * Returns 1 if the addresses are the same.  Cheaper than
+ * inXaddr_cmp() when no ordering is needed.
+ */
+int
+inXaddr_equal(const inX_addr *a, const inX_addr *b)
+{
+	return 0 == memcmp(a, b, sizeof(*a));
 }
 
 int
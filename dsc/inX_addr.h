@@ -21,6 +21,7 @@ extern const char * inXaddr_ntop(const inX_addr *, char *, socklen_t len);
 extern int inXaddr_pton(const char *, inX_addr *);
 extern unsigned int inXaddr_hash(const inX_addr *);
 extern int inXaddr_cmp(const inX_addr *a, const inX_addr *b);
+extern int inXaddr_equal(const inX_addr *a, const inX_addr *b);
 extern inX_addr inXaddr_mask (const inX_addr *a, const inX_addr *mask);
 
 extern int inXaddr_assign_v4(inX_addr *, const struct in_addr *);
@@ -0,0 +1,93 @@
+#include "config.h"
+#include <stdlib.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "index_limit.h"
+
+static char overflow_label[] = "-:OVERFLOW:-";
+
+/*
+ * Indexers are shared between datasets, so when several datasets ask
+ * for a limit on the same indexer the largest one wins.
+ */
+void
+index_limit_set(index_limit *l, int max_keys)
+{
+    if (max_keys > l->max_keys)
+	l->max_keys = max_keys;
+}
+
+/*
+ * Returns 1 (and counts an overflow hit) if a dictionary with 'keys'
+ * entries may not get another one.  The caller then returns
+ * l->max_keys as the index.
+ */
+int
+index_limit_reached(index_limit *l, int keys)
+{
+    if (0 == l->max_keys || keys < l->max_keys)
+	return 0;
+    l->overflow++;
+    return 1;
+}
+
+void
+index_limit_iter_init(index_limit *l)
+{
+    l->iter_overflow = l->overflow ? 1 : 0;
+}
+
+/*
+ * To be called when the dictionary iteration is done; yields the
+ * overflow index once if it was used.
+ */
+int
+index_limit_iterate(index_limit *l, char **label)
+{
+    if (0 == l->iter_overflow)
+	return -1;
+    l->iter_overflow = 0;
+    *label = overflow_label;
+    return l->max_keys;
+}
+
+void
+index_limit_reset(index_limit *l)
+{
+    l->overflow = 0;
+    l->bytes = 0;
+}
+
+/*
+ * Stats function body for the indexer_stats array.  Called with a
+ * NULL label to start over.
+ */
+int
+index_limit_stats(index_limit *l, int keys, char **label, uint64_t *val)
+{
+    static char *names[] = { "keys", "bytes", "overflow", "max_keys", NULL };
+    if (NULL == label) {
+	l->next_stat = 0;
+	return 0;
+    }
+    if (NULL == names[l->next_stat])
+	return -1;
+    switch (l->next_stat) {
+    case 0:
+	*val = keys;
+	break;
+    case 1:
+	*val = l->bytes;
+	break;
+    case 2:
+	*val = l->overflow;
+	break;
+    case 3:
+	*val = l->max_keys;
+	break;
+    }
+    *label = names[l->next_stat++];
+    return 0;
+}
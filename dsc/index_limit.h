@@ -0,0 +1,26 @@
+#ifndef INDEX_LIMIT_H
+#define INDEX_LIMIT_H
+
+/*
+ * Bookkeeping for indexers that keep a dictionary of keys (client
+ * addresses, names, ...).  With a max_keys limit, keys first seen
+ * after the dictionary is full all share the "-:OVERFLOW:-" index,
+ * which is max_keys, instead of getting an entry of their own.
+ */
+
+typedef struct {
+    int max_keys;		/* 0 for no limit */
+    uint64_t overflow;		/* lookups that got the overflow index */
+    uint64_t bytes;		/* memory used by the dictionary */
+    int iter_overflow;		/* overflow label not iterated yet */
+    int next_stat;
+} index_limit;
+
+void index_limit_set(index_limit *, int max_keys);
+int index_limit_reached(index_limit *, int keys);
+void index_limit_iter_init(index_limit *);
+int index_limit_iterate(index_limit *, char **label);
+void index_limit_reset(index_limit *);
+int index_limit_stats(index_limit *, int keys, char **label, uint64_t *val);
+
+#endif /* INDEX_LIMIT_H */
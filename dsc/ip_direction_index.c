@@ -31,7 +31,7 @@ ip_is_local(const inX_addr *a)
 {
     struct _foo *t;
     for (t = local_addrs; t; t = t->next)
-	if (0 == inXaddr_cmp(&t->addr, a))
+	if (inXaddr_equal(&t->addr, a))
 	    return 1;
     return 0;
 }
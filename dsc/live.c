@@ -0,0 +1,180 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <netinet/in.h>
+
+#include "dns_message.h"
+#include "live.h"
+
+/*
+ * The current second is counted here, and added to the segment and
+ * the totals when it is over, so packet processing only touches
+ * private memory.
+ */
+static int enabled = 0;
+static live_segment *seg = NULL;
+static live_totals now_counts;
+static uint64_t scale = 1;
+static uint64_t last_drops = 0;
+
+/*
+ * The totals have a seqlock of their own, like the segment's.
+ */
+static live_totals totals;
+static uint32_t totals_seq = 0;
+
+int
+live_open(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void *p;
+    if (fd < 0) {
+	syslog(LOG_ERR, "%s: %s", path, strerror(errno));
+	return 0;
+    }
+    if (ftruncate(fd, sizeof(*seg)) < 0) {
+	syslog(LOG_ERR, "%s: %s", path, strerror(errno));
+	close(fd);
+	return 0;
+    }
+    p = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+	syslog(LOG_ERR, "mmap %s: %s", path, strerror(errno));
+	return 0;
+    }
+    seg = p;
+    seg->version = LIVE_VERSION;
+    seg->size = sizeof(*seg);
+    seg->nslots = LIVE_SLOTS;
+    __atomic_store_n(&seg->magic, LIVE_MAGIC, __ATOMIC_RELEASE);
+    enabled = 1;
+    return 1;
+}
+
+void
+live_enable(void)
+{
+    enabled = 1;
+}
+
+/*
+ * Counts are scaled like the data files' (see sample.h).
+ */
+void
+live_count_scale(unsigned int s)
+{
+    scale = s;
+}
+
+void
+live_packets(unsigned int n)
+{
+    now_counts.packets += n;
+}
+
+void
+live_message(const dns_message *m)
+{
+    if (!enabled)
+	return;
+    if (m->qr) {
+	now_counts.responses += scale;
+	now_counts.rcode[m->rcode & (LIVE_RCODES - 1)] += scale;
+    } else {
+	now_counts.queries += scale;
+	now_counts.qtype[m->qtype < LIVE_QTYPES ? m->qtype : LIVE_QTYPES - 1] += scale;
+	now_counts.opcode[m->opcode & (LIVE_OPCODES - 1)] += scale;
+    }
+    if (IPPROTO_TCP == m->tm->proto)
+	now_counts.tcp += scale;
+    else
+	now_counts.udp += scale;
+}
+
+int
+live_second_over(time_t now)
+{
+    return enabled && (uint32_t) now != now_counts.sec;
+}
+
+static void
+live_add(uint64_t *to, const uint64_t *from, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+	to[i] += from[i];
+}
+
+/*
+ * Adds the second that is over to the segment and the totals, and
+ * starts counting the next one.  drops_total is the kernel's running
+ * count of drops.
+ */
+void
+live_publish(time_t now, uint64_t drops_total)
+{
+    live_totals *n = &now_counts;
+    uint32_t s;
+    if (!enabled)
+	return;
+    if (n->sec) {
+	n->drops = drops_total - last_drops;
+	if (seg) {
+	    live_second *l;
+	    s = seg->seq;
+	    __atomic_store_n(&seg->seq, s + 1, __ATOMIC_RELAXED);
+	    __atomic_thread_fence(__ATOMIC_RELEASE);
+	    l = &seg->slot[n->sec % LIVE_SLOTS];
+	    l->sec = n->sec;
+	    l->packets = n->packets;
+	    l->queries = n->queries;
+	    l->responses = n->responses;
+	    l->drops = n->drops;
+	    memcpy(l->rcode, n->rcode, sizeof(l->rcode));
+	    memcpy(l->qtype, n->qtype, sizeof(l->qtype));
+	    seg->last = n->sec;
+	    __atomic_store_n(&seg->seq, s + 2, __ATOMIC_RELEASE);
+	}
+	s = totals_seq;
+	__atomic_store_n(&totals_seq, s + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	totals.sec = n->sec;
+	totals.packets += n->packets;
+	totals.queries += n->queries;
+	totals.responses += n->responses;
+	totals.drops += n->drops;
+	live_add(totals.rcode, n->rcode, LIVE_RCODES);
+	live_add(totals.qtype, n->qtype, LIVE_QTYPES);
+	live_add(totals.opcode, n->opcode, LIVE_OPCODES);
+	totals.udp += n->udp;
+	totals.tcp += n->tcp;
+	__atomic_store_n(&totals_seq, s + 2, __ATOMIC_RELEASE);
+    }
+    last_drops = drops_total;
+    memset(n, 0, sizeof(*n));
+    n->sec = now;
+}
+
+/*
+ * Copies the totals, from any thread.
+ */
+void
+live_totals_read(live_totals *t)
+{
+    uint32_t s;
+    do {
+	while ((s = __atomic_load_n(&totals_seq, __ATOMIC_ACQUIRE)) & 1);
+	memcpy(t, &totals, sizeof(*t));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (s != __atomic_load_n(&totals_seq, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,85 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Live counters (live_stats).  dsc keeps per-second totals for the
+ * last LIVE_SLOTS seconds in a small file, normally in /dev/shm, that
+ * readers map and read without system calls.  Each second is copied
+ * into its slot (the time modulo LIVE_SLOTS) once it is over.
+ *
+ * Readers use the sequence number as a seqlock: it is odd while a
+ * slot is being written, so a reader takes it (skipping odd values),
+ * copies what it needs, and starts over if seq has changed since:
+ *
+ *	do {
+ *	    while ((s = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE)) & 1);
+ *	    copy = seg->slot[seg->last % LIVE_SLOTS];
+ *	    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *	} while (s != __atomic_load_n(&seg->seq, __ATOMIC_RELAXED));
+ *
+ * A slot whose sec is not the second expected had no traffic.  The
+ * layout only changes with LIVE_VERSION.  Counts are scaled like the
+ * data files' when sampling.
+ */
+
+#define LIVE_MAGIC 0x5644534cU	/* "LSDV" on little endian hosts */
+#define LIVE_VERSION 1
+#define LIVE_SLOTS 64
+#define LIVE_RCODES 16
+#define LIVE_QTYPES 257		/* the last one counts qtypes above 255 */
+#define LIVE_OPCODES 16
+
+typedef struct {
+    uint32_t sec;		/* the second, 0 if never used */
+    uint32_t pad;
+    uint64_t packets;
+    uint64_t queries;
+    uint64_t responses;
+    uint64_t drops;		/* by the kernel */
+    uint64_t rcode[LIVE_RCODES];	/* of responses */
+    uint64_t qtype[LIVE_QTYPES];	/* of queries */
+} live_second;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;		/* of the segment, in bytes */
+    uint32_t nslots;
+    uint32_t seq;		/* odd while a slot is written */
+    uint32_t last;		/* the latest second written */
+    live_second slot[LIVE_SLOTS];
+} live_segment;
+
+/*
+ * Running totals since dsc started, for the metrics listener.  They
+ * are kept in the process, not in the segment, and are counted even
+ * without live_stats once live_enable() has been called.
+ */
+typedef struct {
+    uint32_t sec;		/* the latest second added */
+    uint64_t packets;
+    uint64_t queries;
+    uint64_t responses;
+    uint64_t drops;
+    uint64_t rcode[LIVE_RCODES];
+    uint64_t qtype[LIVE_QTYPES];
+    uint64_t opcode[LIVE_OPCODES];	/* of queries */
+    uint64_t udp;		/* queries and responses */
+    uint64_t tcp;
+} live_totals;
+
+struct _dns_message;
+
+int live_open(const char *path);
+void live_enable(void);
+void live_totals_read(live_totals *);
+void live_count_scale(unsigned int);
+void live_packets(unsigned int);
+void live_message(const struct _dns_message *);
+int live_second_over(time_t now);
+void live_publish(time_t now, uint64_t drops_total);
+
+#endif /* LIVE_H */
@@ -9,11 +9,41 @@
 #include "xmalloc.h"
 #include "dataset_opt.h"
 #include "md_array.h"
+#include "space_saving.h"
+#include "hll.h"
 #include "dns_message.h"
 #include "pcap.h"
 #include "syslog_debug.h"
 
 static void md_array_grow(md_array * a, int i1, int i2);
+static uint64_t md_array_sparse_add(md_array * a, int i1, int i2, uint64_t n);
+static void md_array_make_sparse(md_array * a);
+static int md_array_topk_add(md_array * a, int i1, int i2, uint64_t n);
+static int md_array_hll_add(md_array * a, int i1, uint64_t hash);
+
+/*
+ * With automatic storage selection (sparse=-1), an array switches from
+ * dense rows to the sparse cell table as soon as either dimension
+ * would have to grow beyond this many slots.
+ */
+#define MD_ARRAY_DENSE_MAX 4096
+#define MD_ARRAY_SPARSE_MIN 64
+
+/*
+ * Every message gets a new serial number.  An indexer remembers the
+ * serial and result of its last index_fn() call, so when several
+ * arrays share an indexer it is evaluated only once per message.
+ */
+static unsigned int message_serial = 1;
+
+/*
+ * Time span of the data being printed, for the printers' array
+ * headers.
+ */
+static int print_start_time;
+static int print_finish_time;
+
+static uint64_t count_scale = 1;	/* see md_array_count_scale() */
 
 static void
 md_array_free(md_array *a)
@@ -33,6 +63,11 @@ md_array_clear(md_array *a)
 {
     /* a->array contents were in an arena, so we don't need to free them. */
     a->array = NULL;
+    a->sparse.cells = NULL;
+    a->sparse.alloc_sz = 0;
+    a->sparse.used = 0;
+    a->topk.rows = NULL;
+    a->hll.rows = NULL;
     a->d1.alloc_sz = 0;
     if (a->d1.indexer->reset_fn)
 	a->d1.indexer->reset_fn();
@@ -73,39 +108,387 @@ md_array_create(const char *name, filter_list * fl,
     return a;
 }
 
+void
+md_array_new_message(void)
+{
+    if (0 == ++message_serial)
+	message_serial = 1;	/* 0 is never a valid serial */
+}
+
+unsigned int
+md_array_message_serial(void)
+{
+    return message_serial;
+}
+
+static int
+md_array_index(indexer_t *indexer, const void *vp)
+{
+    if (indexer->memo.serial == message_serial) {
+	indexer->memo.hits++;
+	return indexer->memo.index;
+    }
+    indexer->memo.misses++;
+    indexer->memo.index = indexer->index_fn(vp);
+    indexer->memo.serial = message_serial;
+    return indexer->memo.index;
+}
+
+/*
+ * Everything counted is multiplied by 'scale', so that sampled
+ * intervals report estimates of the full counts.
+ */
+void
+md_array_count_scale(unsigned int scale)
+{
+    count_scale = scale;
+}
+
+/*
+ * Adds a message to its cell: 1 for plain counting, or whatever the
+ * array's weight_fn says (e.g. the message length).  Returns -1 if
+ * the message was filtered out or could not be indexed.
+ */
 int
 md_array_count(md_array * a, const void *vp)
 {
     int i1;
     int i2;
+    uint64_t n;
+    uint64_t hash;
     filter_list *fl;
 
     for (fl = a->filter_list; fl; fl = fl->next)
 	if (0 == fl->filter->func(vp, fl->filter->context))
 	    return -1;
 
-    if ((i1 = a->d1.indexer->index_fn(vp)) < 0)
+    if ((i1 = md_array_index(a->d1.indexer, vp)) < 0)
 	return -1;
-    if ((i2 = a->d2.indexer->index_fn(vp)) < 0)
+    if (a->opts.hll) {
+	/* the 2nd dimension is only hashed, its indexer never grows */
+	if (a->d2.indexer->hash_fn(vp, &hash) < 0)
+	    return -1;
+	return md_array_hll_add(a, i1, hash);
+    }
+    if ((i2 = md_array_index(a->d2.indexer, vp)) < 0)
 	return -1;
 
+    n = a->weight_fn ? a->weight_fn(vp) : 1;
+    n *= count_scale;
+
+    return md_array_add(a, i1, i2, n);
+}
+
+/*
+ * Adds 'n' to cell (i1,i2), whatever the storage.
+ */
+int
+md_array_add(md_array * a, int i1, int i2, uint64_t n)
+{
+    if (a->opts.topk > 0)
+	return md_array_topk_add(a, i1, i2, n);
+    if (a->sparse.cells || 1 == a->opts.sparse)
+	return md_array_sparse_add(a, i1, i2, n) ? 0 : -1;
+
     md_array_grow(a, i1, i2);
+    if (a->sparse.cells)	/* md_array_grow() switched to sparse storage */
+	return md_array_sparse_add(a, i1, i2, n) ? 0 : -1;
 
     assert(i1 < a->d1.alloc_sz);
     assert(i2 < a->d2.alloc_sz);
-    return ++a->array[i1].array[i2];
+    a->array[i1].array[i2] += n;
+    return 0;
+}
+
+/* ==== SPARSE STORAGE ==================================================== */
+
+/*
+ * Sparse storage keeps (i1,i2) -> count in one open-addressed table
+ * with linear probing, so high-cardinality arrays only pay for the
+ * cells that are actually non-zero.  Like the dense rows, the table
+ * lives in the arena.
+ */
+
+static unsigned int
+md_array_sparse_hash(int i1, int i2)
+{
+    unsigned int h = (unsigned int) i1 * 0x9E3779B1U;
+    h ^= (unsigned int) i2 * 0x85EBCA6BU;
+    return h ^ (h >> 15);
+}
+
+static struct _md_array_cell *
+md_array_sparse_find(struct _md_array_cell *cells, unsigned int alloc_sz,
+    int i1, int i2)
+{
+    unsigned int mask = alloc_sz - 1;
+    unsigned int slot = md_array_sparse_hash(i1, i2) & mask;
+    for (;; slot = (slot + 1) & mask) {
+	struct _md_array_cell *c = &cells[slot];
+	if (0 == c->count || (c->i1 == i1 && c->i2 == i2))
+	    return c;
+    }
+}
+
+static int
+md_array_sparse_grow(md_array * a)
+{
+    unsigned int new_sz = a->sparse.alloc_sz << 1;
+    struct _md_array_cell *cells;
+    unsigned int i;
+
+    if (new_sz == 0)
+	new_sz = MD_ARRAY_SPARSE_MIN;
+    cells = acalloc(new_sz, sizeof(*cells));
+    if (NULL == cells)
+	return 0;
+    for (i = 0; i < a->sparse.alloc_sz; i++) {
+	struct _md_array_cell *c = &a->sparse.cells[i];
+	if (c->count)
+	    *md_array_sparse_find(cells, new_sz, c->i1, c->i2) = *c;
+    }
+    if (a->sparse.cells)
+	afree(a->sparse.cells);
+    a->sparse.cells = cells;
+    a->sparse.alloc_sz = new_sz;
+    return 1;
+}
+
+/*
+ * Returns the new count of the cell, or 0 if it could not be stored.
+ */
+static uint64_t
+md_array_sparse_add(md_array * a, int i1, int i2, uint64_t n)
+{
+    struct _md_array_cell *c;
+
+    /* keep the load factor at or below 3/4 */
+    if (a->sparse.used >= a->sparse.alloc_sz - (a->sparse.alloc_sz >> 2))
+	if (!md_array_sparse_grow(a))
+	    return 0;
+    c = md_array_sparse_find(a->sparse.cells, a->sparse.alloc_sz, i1, i2);
+    if (0 == c->count) {
+	c->i1 = i1;
+	c->i2 = i2;
+	a->sparse.used++;
+	/* for sparse arrays alloc_sz is just one more than the largest index */
+	if (i1 >= a->d1.alloc_sz)
+	    a->d1.alloc_sz = i1 + 1;
+	if (i2 >= a->d2.alloc_sz)
+	    a->d2.alloc_sz = i2 + 1;
+    }
+    return c->count += n;
+}
+
+static void
+md_array_make_sparse(md_array * a)
+{
+    struct _md_array_node *d1 = a->array;
+    int i1, i2;
+
+    syslog(LOG_DEBUG, "switching %s to sparse storage", a->name);
+    if (!md_array_sparse_grow(a))
+	return;
+    for (i1 = 0; i1 < a->d1.alloc_sz; i1++)
+	for (i2 = 0; i2 < d1[i1].alloc_sz; i2++)
+	    if (d1[i1].array[i2])
+		md_array_sparse_add(a, i1, i2, d1[i1].array[i2]);
+    /* dense rows were in the arena, so we don't need to free them. */
+    a->array = NULL;
+}
+
+static int
+compare_cell_index(const void *A, const void *B)
+{
+    const struct _md_array_cell *a = A;
+    const struct _md_array_cell *b = B;
+    if (a->i1 != b->i1)
+	return a->i1 < b->i1 ? -1 : 1;
+    if (a->i2 != b->i2)
+	return a->i2 < b->i2 ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Copy the used cells out of the sparse table, sorted by (i1,i2).
+ * (*rows)[i1] is the offset of the first cell of row i1, and
+ * (*rows)[i1+1] the offset just past its last cell.
+ */
+static struct _md_array_cell *
+md_array_sparse_rows(md_array * a, int **rows)
+{
+    struct _md_array_cell *cells;
+    unsigned int i;
+    int n = 0;
+    int i1;
+
+    cells = xcalloc(a->sparse.used + 1, sizeof(*cells));
+    *rows = xcalloc(a->d1.alloc_sz + 1, sizeof(**rows));
+    if (NULL == cells || NULL == *rows) {
+	xfree(cells);
+	xfree(*rows);
+	return NULL;
+    }
+    for (i = 0; i < a->sparse.alloc_sz; i++)
+	if (a->sparse.cells[i].count)
+	    cells[n++] = a->sparse.cells[i];
+    qsort(cells, n, sizeof(*cells), compare_cell_index);
+    for (i = 0, i1 = 0; i1 <= a->d1.alloc_sz; i1++) {
+	while (i < n && cells[i].i1 < i1)
+	    i++;
+	(*rows)[i1] = i;
+    }
+    return cells;
+}
+
+static uint64_t
+md_array_sparse_value(const struct _md_array_cell *row, int n, int i2)
+{
+    int lo = 0;
+    int hi = n - 1;
+    while (lo <= hi) {
+	int mid = (lo + hi) / 2;
+	if (row[mid].i2 == i2)
+	    return row[mid].count;
+	if (row[mid].i2 < i2)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+    return 0;
+}
+
+/* ==== TOP-K STORAGE ===================================================== */
+
+/*
+ * With the 'topk=K' option every row is a fixed size Space-Saving
+ * summary of K counters, so memory stays bounded no matter how many
+ * distinct 2nd dimension values show up.  Counts are estimates; see
+ * space_saving.h for the error bounds.
+ */
+
+static int
+md_array_topk_add(md_array * a, int i1, int i2, uint64_t n)
+{
+    if (i1 >= a->d1.alloc_sz) {
+	struct _space_saving **rows;
+	int new_d1_sz = a->d1.alloc_sz ? a->d1.alloc_sz : 2;
+	while (i1 >= new_d1_sz)
+	    new_d1_sz = new_d1_sz << 1;
+	rows = acalloc(new_d1_sz, sizeof(*rows));
+	if (NULL == rows)
+	    return -1;
+	memcpy(rows, a->topk.rows, a->d1.alloc_sz * sizeof(*rows));
+	a->topk.rows = rows;
+	a->d1.alloc_sz = new_d1_sz;
+    }
+    if (NULL == a->topk.rows[i1]) {
+	a->topk.rows[i1] = ss_create(a->opts.topk);
+	if (NULL == a->topk.rows[i1])
+	    return -1;
+    }
+    ss_add(a->topk.rows[i1], i2, n);
+    if (i2 >= a->d2.alloc_sz)
+	a->d2.alloc_sz = i2 + 1;
+    return 0;
+}
+
+/* ==== HYPERLOGLOG STORAGE =============================================== */
+
+/*
+ * With the 'hll=P' option a row is not a set of cells but a
+ * HyperLogLog sketch of the distinct 2nd dimension values seen with
+ * that 1st dimension value.
+ */
+
+/*
+ * Returns the sketch for row i1, making it if need be.
+ */
+static struct _hll *
+md_array_hll_row(md_array * a, int i1)
+{
+    if (i1 >= a->d1.alloc_sz) {
+	struct _hll **rows;
+	int new_d1_sz = a->d1.alloc_sz ? a->d1.alloc_sz : 2;
+	while (i1 >= new_d1_sz)
+	    new_d1_sz = new_d1_sz << 1;
+	rows = acalloc(new_d1_sz, sizeof(*rows));
+	if (NULL == rows)
+	    return NULL;
+	memcpy(rows, a->hll.rows, a->d1.alloc_sz * sizeof(*rows));
+	a->hll.rows = rows;
+	a->d1.alloc_sz = new_d1_sz;
+    }
+    if (NULL == a->hll.rows[i1])
+	a->hll.rows[i1] = hll_create(a->opts.hll);
+    return a->hll.rows[i1];
+}
+
+static int
+md_array_hll_add(md_array * a, int i1, uint64_t hash)
+{
+    hll *h = md_array_hll_row(a, i1);
+    if (NULL == h)
+	return -1;
+    hll_add(h, hash);
+    return 0;
+}
+
+/*
+ * Merges a sketch into row i1 of an hll array (for rollups).
+ */
+int
+md_array_hll_merge(md_array * a, int i1, const struct _hll *src)
+{
+    hll *h = md_array_hll_row(a, i1);
+    if (NULL == h || !hll_merge(h, src))
+	return -1;
+    return 0;
+}
+
+/*
+ * An hll row is printed as three pseudo-cells: the estimate, its
+ * standard error, and the registers so that sketches can be merged
+ * later (the count of the last one is the precision).
+ */
+static void
+md_array_print_hll(md_array * a, md_array_printer * pr, FILE *fp, int i1)
+{
+    const hll *h = a->hll.rows[i1];
+    char *buf;
+    if (NULL == h)
+	return;
+    pr->print_element(fp, "-:HLL_ESTIMATE:-", (uint64_t) (hll_estimate(h) + 0.5));
+    pr->print_element(fp, "-:HLL_ERROR:-", (uint64_t) (hll_error(h) + 0.5));
+    buf = xmalloc(strlen("-:HLL_REGISTERS:") + HLL_ENCODED_SZ(h->p));
+    if (NULL == buf) {
+	syslog(LOG_CRIT, "%s", "Cant output XML file chunk due to malloc failure!");
+	return;
+    }
+    strcpy(buf, "-:HLL_REGISTERS:");
+    hll_encode(h, buf + strlen(buf), HLL_ENCODED_SZ(h->p));
+    pr->print_element(fp, buf, h->p);
+    xfree(buf);
 }
 
+/* ==== DENSE STORAGE ===================================================== */
+
 static void
 md_array_grow(md_array * a, int i1, int i2)
 {
     int new_d1_sz, new_d2_sz;
     struct _md_array_node *d1 = NULL;
-    int *d2 = NULL;
+    uint64_t *d2 = NULL;
 
     if (i1 < a->d1.alloc_sz && i2 < a->array[i1].alloc_sz)
 	return;
 
+    if (-1 == a->opts.sparse &&
+	(i1 >= MD_ARRAY_DENSE_MAX || i2 >= MD_ARRAY_DENSE_MAX)) {
+	md_array_make_sparse(a);
+	return;
+    }
+
     /* dimension 1 */
     new_d1_sz = a->d1.alloc_sz;
     if (i1 >= a->d1.alloc_sz) {
@@ -173,20 +556,129 @@ md_array_grow(md_array * a, int i1, int i2)
 	a->d2.alloc_sz = new_d2_sz;
 }
 
-struct _foo {
+/*
+ * A cell competing for one of a row's max-cells places.  'seq' is its
+ * position in the d2 iteration, which breaks ties between equal
+ * counts and finds the label again once the winners are known.
+ */
+struct _ranked {
+    int i2;
+    int seq;
+    uint64_t val;
     char *label;
-    int val;
 };
 
 /*
- * descending sort order (larger to smaller)
+ * Value of cell (i1,i2) for md_array_print() and md_array_walk().
+ * 'cells' and 'rows' come from md_array_sparse_rows() for sparse
+ * storage, 'ss' is row i1's summary for top-K storage.
  */
+static uint64_t
+md_array_value(md_array * a, int i1, int i2,
+    const struct _md_array_cell *cells, const int *rows,
+    const struct _space_saving *ss)
+{
+    if (ss) {
+	const ss_counter *c = ss_find(ss, i2);
+	return c ? c->count : 0;
+    }
+    if (cells)
+	return md_array_sparse_value(cells + rows[i1],
+	    rows[i1 + 1] - rows[i1], i2);
+    if (i2 >= a->array[i1].alloc_sz)
+	return 0;
+    return a->array[i1].array[i2];
+}
+
+/*
+ * Ranking order: larger counts first, then iteration order.
+ */
+static int
+rank_before(const struct _ranked *a, const struct _ranked *b)
+{
+    if (a->val != b->val)
+	return a->val > b->val;
+    return a->seq < b->seq;
+}
+
+static int
+compare_rank(const void *A, const void *B)
+{
+    const struct _ranked *a = A;
+    const struct _ranked *b = B;
+    if (a->seq == b->seq)
+	return 0;
+    return rank_before(a, b) ? -1 : 1;
+}
+
 static int
-compare(const void *A, const void *B)
+compare_seq(const void *A, const void *B)
+{
+    const struct _ranked *a = A;
+    const struct _ranked *b = B;
+    if (a->seq == b->seq)
+	return 0;
+    return a->seq < b->seq ? -1 : 1;
+}
+
+/*
+ * The places are kept in a heap with the lowest ranked cell on top,
+ * so a newcomer only has to beat heap[0].
+ */
+static void
+rank_sift_up(struct _ranked *heap, int i)
 {
-    const struct _foo *a = A;
-    const struct _foo *b = B;
-    return b->val - a->val;
+    while (i > 0) {
+	int parent = (i - 1) / 2;
+	struct _ranked t;
+	if (!rank_before(&heap[parent], &heap[i]))
+	    break;
+	t = heap[parent];
+	heap[parent] = heap[i];
+	heap[i] = t;
+	i = parent;
+    }
+}
+
+static void
+rank_sift_down(struct _ranked *heap, int n, int i)
+{
+    for (;;) {
+	int c = 2 * i + 1;
+	struct _ranked t;
+	if (c >= n)
+	    break;
+	if (c + 1 < n && rank_before(&heap[c], &heap[c + 1]))
+	    c++;
+	if (!rank_before(&heap[i], &heap[c]))
+	    break;
+	t = heap[c];
+	heap[c] = heap[i];
+	heap[i] = t;
+	i = c;
+    }
+}
+
+/*
+ * Labels are only copied for the cells that are printed: a second
+ * pass over the d2 labels picks them up by iteration position.
+ */
+static void
+md_array_rank_labels(md_array * a, struct _ranked *top, int ntop)
+{
+    char *label2;
+    int i2;
+    int seq = 0;
+    int w = 0;
+    qsort(top, ntop, sizeof(*top), compare_seq);
+    a->d2.indexer->iter_fn(NULL);
+    while (w < ntop && (i2 = a->d2.indexer->iter_fn(&label2)) > -1) {
+	if (seq++ != top[w].seq)
+	    continue;
+	assert(i2 == top[w].i2);
+	top[w++].label = xstrdup(label2);
+    }
+    qsort(top, ntop, sizeof(*top), compare_rank);
 }
 
 int
@@ -196,7 +688,16 @@ md_array_print(md_array * a, md_array_printer * pr, FILE *fp)
     char *label2;
     int i1;
     int i2;
+    struct _md_array_cell *cells = NULL;
+    int *rows = NULL;
 
+    if (a->sparse.cells) {
+	cells = md_array_sparse_rows(a, &rows);
+	if (NULL == cells) {
+	    syslog(LOG_CRIT, "%s", "Cant output XML file chunk due to malloc failure!");
+	    return -1;
+	}
+    }
     a->d1.indexer->iter_fn(NULL);
     pr->start_array(fp, a->name);
     pr->d1_type(fp, a->d1.type);
@@ -204,64 +705,176 @@ md_array_print(md_array * a, md_array_printer * pr, FILE *fp)
     pr->start_data(fp);
     while ((i1 = a->d1.indexer->iter_fn(&label1)) > -1) {
 	int skipped = 0;
-	int skipped_sum = 0;
+	uint64_t skipped_sum = 0;
 	int nvals;
-	int si = 0;
-	struct _foo *sortme = NULL;
+	int ntop = 0;
+	int seq = 0;
+	int si;
+	struct _ranked *top = NULL;
+	struct _space_saving *ss = NULL;
 	if (i1 >= a->d1.alloc_sz)
 	    continue;		/* see [1] */
 	pr->d1_begin(fp, label1);
+	if (a->hll.rows) {
+	    md_array_print_hll(a, pr, fp, i1);
+	    pr->d1_end(fp, label1);
+	    continue;
+	}
+	if (a->topk.rows)
+	    ss = a->topk.rows[i1];
+	if ((cells && rows[i1] == rows[i1 + 1]) || (a->topk.rows && !ss)) {
+	    pr->d1_end(fp, label1);
+	    continue;		/* nothing in this row */
+	}
 	a->d2.indexer->iter_fn(NULL);
-	nvals = a->d2.alloc_sz;
-	sortme = xcalloc(nvals, sizeof(*sortme));
-	if (NULL == sortme) {
+	if (ss)
+	    nvals = ss->used;
+	else if (cells)
+	    nvals = rows[i1 + 1] - rows[i1];
+	else
+	    nvals = a->d2.alloc_sz;
+	if (a->opts.max_cells && a->opts.max_cells < nvals)
+	    nvals = a->opts.max_cells;
+	top = xcalloc(nvals, sizeof(*top));
+	if (NULL == top) {
 	    syslog(LOG_CRIT, "%s", "Cant output XML file chunk due to malloc failure!");
 	    continue;		/* OUCH! */
 	}
 	while ((i2 = a->d2.indexer->iter_fn(&label2)) > -1) {
-	    int val;
-	    if (i2 >= a->array[i1].alloc_sz)
+	    struct _ranked r;
+	    r.seq = seq++;
+	    r.val = md_array_value(a, i1, i2, cells, rows, ss);
+	    if (0 == r.val)
 		continue;
-	    val = a->array[i1].array[i2];
-	    if (0 == val)
-		continue;
-	    if (a->opts.min_count && (a->opts.min_count > val)) {
+	    if (a->opts.min_count && ((uint64_t) a->opts.min_count > r.val)) {
 		skipped++;
-		skipped_sum += val;
+		skipped_sum += r.val;
 		continue;
 	    }
-	    sortme[si].val = val;
-	    sortme[si].label = xstrdup(label2);
-	    if (NULL == sortme[si].label)
-		break;
-	    si++;
-	}
-	assert(si <= nvals);
-	nvals = si;
-	qsort(sortme, nvals, sizeof(*sortme), compare);
-	for (si = 0; si < nvals; si++) {
-	    if (0 == a->opts.max_cells || si < a->opts.max_cells) {
-		pr->print_element(fp, sortme[si].label, sortme[si].val);
+	    r.i2 = i2;
+	    r.label = NULL;
+	    if (ntop < nvals) {
+		top[ntop] = r;
+		rank_sift_up(top, ntop++);
+		continue;
+	    }
+	    /* every place is taken; r or the lowest ranked cell is skipped */
+	    skipped++;
+	    if (rank_before(&r, &top[0])) {
+		skipped_sum += top[0].val;
+		top[0] = r;
+		rank_sift_down(top, ntop, 0);
 	    } else {
-		skipped++;
-		skipped_sum += sortme[si].val;
+		skipped_sum += r.val;
 	    }
-	    xfree(sortme[si].label);
-	    sortme[si].label = NULL;
+	}
+	md_array_rank_labels(a, top, ntop);
+	for (si = 0; si < ntop; si++) {
+	    if (top[si].label)
+		pr->print_element(fp, top[si].label, top[si].val);
+	    xfree(top[si].label);
 	}
 	if (skipped) {
 	    pr->print_element(fp, "-:SKIPPED:-", skipped);
 	    pr->print_element(fp, "-:SKIPPED_SUM:-", skipped_sum);
 	}
+	if (ss && ss_error_bound(ss))
+	    pr->print_element(fp, "-:TOPK_ERROR:-", ss_error_bound(ss));
 	pr->d1_end(fp, label1);
-	xfree(sortme);
-	sortme = NULL;
+	xfree(top);
     }
     pr->finish_data(fp);
     pr->finish_array(fp);
+    if (cells) {
+	xfree(cells);
+	xfree(rows);
+    }
     return 0;
 }
 
+/*
+ * Calls 'fn' with the labels and value of every non-zero cell, before
+ * any min-count or max-cells filtering.  Arrays of HyperLogLog
+ * sketches have no cells to visit.
+ */
+void
+md_array_walk(md_array * a, md_array_walk_fn *fn, void *ctx)
+{
+    char *label1;
+    char *label2;
+    int i1;
+    int i2;
+    struct _md_array_cell *cells = NULL;
+    int *rows = NULL;
+
+    if (a->hll.rows)
+	return;
+    if (a->sparse.cells) {
+	cells = md_array_sparse_rows(a, &rows);
+	if (NULL == cells)
+	    return;
+    }
+    a->d1.indexer->iter_fn(NULL);
+    while ((i1 = a->d1.indexer->iter_fn(&label1)) > -1) {
+	struct _space_saving *ss = NULL;
+	if (i1 >= a->d1.alloc_sz)
+	    continue;		/* see [1] */
+	if (a->topk.rows && NULL == (ss = a->topk.rows[i1]))
+	    continue;
+	if (cells && rows[i1] == rows[i1 + 1])
+	    continue;
+	a->d2.indexer->iter_fn(NULL);
+	while ((i2 = a->d2.indexer->iter_fn(&label2)) > -1) {
+	    uint64_t val = md_array_value(a, i1, i2, cells, rows, ss);
+	    if (val)
+		fn(ctx, label1, label2, val);
+	}
+    }
+    if (cells) {
+	xfree(cells);
+	xfree(rows);
+    }
+}
+
+/*
+ * Calls fn with each row's sketch of an hll array.
+ */
+void
+md_array_walk_hll(md_array * a, md_array_walk_hll_fn *fn, void *ctx)
+{
+    char *label1;
+    int i1;
+
+    if (NULL == a->hll.rows)
+	return;
+    a->d1.indexer->iter_fn(NULL);
+    while ((i1 = a->d1.indexer->iter_fn(&label1)) > -1) {
+	if (i1 >= a->d1.alloc_sz)
+	    continue;		/* see [1] */
+	if (a->hll.rows[i1])
+	    fn(ctx, label1, a->hll.rows[i1]);
+    }
+}
+
+void
+md_array_print_times(int start, int finish)
+{
+    print_start_time = start;
+    print_finish_time = finish;
+}
+
+int
+md_array_print_start_time(void)
+{
+    return print_start_time;
+}
+
+int
+md_array_print_finish_time(void)
+{
+    return print_finish_time;
+}
+
 
 /* [1]
  * Its okay (not a bug) for the indexer's index to be larger
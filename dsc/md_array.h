@@ -1,4 +1,7 @@
-
+#include "config.h"
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
 
 typedef struct _md_array md_array;
 typedef struct _md_array_printer md_array_printer;
@@ -13,6 +16,15 @@ typedef struct {
     int (*index_fn) (const void *);
     int (*iter_fn) (char **);
     void (*reset_fn) (void);
+    int (*hash_fn) (const void *, uint64_t *);	/* for hll datasets, may be NULL */
+    int (*stats_fn) (char **, uint64_t *);	/* reported as indexer_stats, may be NULL */
+    void (*limit_fn) (int);	/* sets max-keys, may be NULL */
+    struct {
+	unsigned int serial;	/* message serial that 'index' belongs to */
+	int index;		/* index_fn() result for that message */
+	unsigned int hits;	/* index_fn() calls avoided */
+	unsigned int misses;	/* index_fn() calls made */
+    } memo;
 } indexer_t;
 
 struct _filter_defn {
@@ -28,7 +40,17 @@ struct _filter_list {
 
 struct _md_array_node {
     int alloc_sz;
-    int *array;
+    uint64_t *array;
+};
+
+/*
+ * A cell of the sparse (open-addressed) storage.  Cells with a zero
+ * count are unused.
+ */
+struct _md_array_cell {
+    int i1;
+    int i2;
+    uint64_t count;
 };
 
 struct _md_array {
@@ -45,7 +67,19 @@ struct _md_array {
 	int alloc_sz;
     } d2;
     dataset_opt opts;
+    unsigned int (*weight_fn) (const void *);	/* NULL means count by 1 */
     struct _md_array_node *array;
+    struct {
+	struct _md_array_cell *cells;	/* NULL when using dense storage */
+	unsigned int alloc_sz;		/* always a power of two */
+	unsigned int used;
+    } sparse;
+    struct {
+	struct _space_saving **rows;	/* NULL unless opts.topk is set */
+    } topk;
+    struct {
+	struct _hll **rows;		/* NULL unless opts.hll is set */
+    } hll;
 };
 
 struct _md_array_printer {
@@ -57,7 +91,7 @@ struct _md_array_printer {
     void (*finish_data) (void *);
     void (*d1_begin) (void *, char *);
     void (*d1_end) (void *, char *);
-    void (*print_element) (void *, char *label, int);
+    void (*print_element) (void *, char *label, uint64_t);
 };
 
 struct _md_array_list {
@@ -65,10 +99,25 @@ struct _md_array_list {
 	md_array_list *next;
 };
 
+typedef void (md_array_walk_fn) (void *ctx, const char *label1,
+    const char *label2, uint64_t val);
+typedef void (md_array_walk_hll_fn) (void *ctx, const char *label1,
+    const struct _hll *);
+
 void md_array_clear(md_array *);
+void md_array_new_message(void);
+unsigned int md_array_message_serial(void);
+void md_array_count_scale(unsigned int);
 int md_array_count(md_array *, const void *);
+int md_array_add(md_array *, int i1, int i2, uint64_t n);
 md_array *md_array_create(const char *name, filter_list *,
     const char *, indexer_t *, const char *, indexer_t *);
 int md_array_print(md_array * a, md_array_printer * pr, FILE *fp);
+void md_array_walk(md_array * a, md_array_walk_fn *, void *ctx);
+void md_array_walk_hll(md_array * a, md_array_walk_hll_fn *, void *ctx);
+int md_array_hll_merge(md_array * a, int i1, const struct _hll *);
+void md_array_print_times(int start, int finish);
+int md_array_print_start_time(void);
+int md_array_print_finish_time(void);
 filter_list ** md_array_filter_list_append(filter_list **fl, FLTR *f);
 FLTR * md_array_create_filter(const char *name, filter_func *, const void *context);
@@ -0,0 +1,222 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <syslog.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "dataset_opt.h"
+#include "md_array.h"
+#include "hashtbl.h"
+#include "xmalloc.h"
+
+/*
+ * Binary data files (version 1).  All numbers are unsigned LEB128
+ * varints; a string is its length followed by its bytes.
+ *
+ *	file	= "DSCB" 0x01 array*
+ *	array	= length body		(length of body in bytes)
+ *	body	= name start_time stop_time d1_type d2_type row*
+ *	row	= label cell* 0
+ *	cell	= label count
+ *
+ * Labels are dictionary encoded per array: 2 * i + 2 refers to the
+ * array's i'th distinct label, and 2 * n + 1 introduces a new label
+ * of n bytes, which follow.  0 ends a row.  Labels are stored as
+ * they are, never base64 encoded.
+ *
+ * The dscbin library reads (and writes) these files.
+ */
+
+typedef struct {
+    unsigned int index;
+    char label[1];		/* allocated to size */
+} dictobj;
+
+static struct {
+    unsigned char *buf;		/* the array's body */
+    size_t len;
+    size_t alloc;
+    hashtbl *dict;
+    unsigned int next_idx;
+    int failed;
+} body;
+
+static hashfunc dict_hashfunc;
+static hashkeycmp dict_cmpfunc;
+
+static void
+body_put(const void *p, size_t n)
+{
+    if (body.failed)
+	return;
+    if (body.len + n > body.alloc) {
+	size_t alloc = body.alloc ? body.alloc : 65536;
+	unsigned char *buf;
+	while (alloc < body.len + n)
+	    alloc *= 2;
+	buf = xrealloc(body.buf, alloc);
+	if (NULL == buf) {
+	    body.failed = 1;
+	    return;
+	}
+	body.buf = buf;
+	body.alloc = alloc;
+    }
+    memcpy(body.buf + body.len, p, n);
+    body.len += n;
+}
+
+static int
+varint_encode(unsigned char *p, uint64_t v)
+{
+    int n = 0;
+    while (v >= 0x80) {
+	p[n++] = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+static void
+body_varint(uint64_t v)
+{
+    unsigned char tmp[10];
+    body_put(tmp, varint_encode(tmp, v));
+}
+
+static void
+body_string(const char *s)
+{
+    size_t n = strlen(s);
+    body_varint(n);
+    body_put(s, n);
+}
+
+static void
+body_label(const char *l)
+{
+    size_t n = strlen(l);
+    dictobj *obj;
+    if (body.dict && (obj = hash_find(l, body.dict))) {
+	body_varint(2 * (uint64_t) obj->index + 2);
+	return;
+    }
+    body_varint(2 * (uint64_t) n + 1);
+    body_put(l, n);
+    if (NULL == body.dict)
+	return;
+    obj = xmalloc(sizeof(*obj) + n);
+    if (NULL == obj) {
+	body.failed = 1;
+	return;
+    }
+    memcpy(obj->label, l, n + 1);
+    obj->index = body.next_idx;
+    if (0 != hash_add(obj->label, obj, body.dict)) {
+	xfree(obj);
+	body.failed = 1;
+	return;
+    }
+    body.next_idx++;
+}
+
+static void
+start_array(void *pr_data, const char *name)
+{
+    body.len = 0;
+    body.failed = 0;
+    body.next_idx = 0;
+    body.dict = hash_create(1024, dict_hashfunc, dict_cmpfunc, 0, NULL, xfree);
+    if (NULL == body.dict)
+	body.failed = 1;
+    body_string(name);
+    body_varint(md_array_print_start_time());
+    body_varint(md_array_print_finish_time());
+}
+
+static void
+finish_array(void *pr_data)
+{
+    FILE *fp = pr_data;
+    unsigned char tmp[10];
+    if (body.dict)
+	hash_destroy(body.dict);
+    body.dict = NULL;
+    if (body.failed) {
+	syslog(LOG_CRIT, "%s", "Cant output binary file chunk due to malloc failure!");
+	return;
+    }
+    fwrite(tmp, 1, varint_encode(tmp, body.len), fp);
+    fwrite(body.buf, 1, body.len, fp);
+}
+
+static void
+d1_type(void *pr_data, const char *t)
+{
+    body_string(t);
+}
+
+static void
+d2_type(void *pr_data, const char *t)
+{
+    body_string(t);
+}
+
+static void
+start_data(void *pr_data)
+{
+}
+
+static void
+finish_data(void *pr_data)
+{
+}
+
+static void
+d1_begin(void *pr_data, char *l)
+{
+    body_label(l);
+}
+
+static void
+print_element(void *pr_data, char *l, uint64_t val)
+{
+    body_label(l);
+    body_varint(val);
+}
+
+static void
+d1_end(void *pr_data, char *l)
+{
+    body_varint(0);
+}
+
+static unsigned int
+dict_hashfunc(const void *key)
+{
+    return hashendian(key, strlen(key), 0);
+}
+
+static int
+dict_cmpfunc(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+md_array_printer binary_printer =
+{
+    start_array,
+    finish_array,
+    d1_type,
+    d2_type,
+    start_data,
+    finish_data,
+    d1_begin,
+    d1_end,
+    print_element
+};
@@ -0,0 +1,298 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <syslog.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "dataset_opt.h"
+#include "md_array.h"
+#include "xmalloc.h"
+
+/*
+ * JSON Lines data files.  Every line is an object; with json_printer
+ * there is one per cell:
+ *
+ *	{"array":"qtype","start_time":1700000000,"stop_time":1700000060,
+ *	 "d1_type":"All","d1":"ALL","d2_type":"Qtype","d2":"1","count":42}
+ *
+ * and with json_rows_printer one per row, the cells in an object:
+ *
+ *	{"array":"qtype",...,"d1":"ALL","d2_type":"Qtype","cells":{"1":42,"28":7}}
+ *
+ * Labels are JSON strings, never base64 encoded.  Label bytes above
+ * 0x7f are written as \u0080 to \u00ff, so any label (qnames need not
+ * be UTF-8) gives valid JSON and the bytes can be recovered.
+ */
+
+/* ==== BUFFERS =========================================================== */
+
+/*
+ * As in the XML printer, output is collected in a buffer and written
+ * out in large pieces, at the latest at the end of each array.  The
+ * start of each line, everything up to the d2 label, is the same for
+ * all of a row's cells, so it is put together once per row in a second
+ * buffer, which grows instead of being written out.
+ */
+#define JSON_BUF_SZ 65536
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t alloc;
+    FILE *fp;			/* NULL for the row prefix */
+} json_buffer;
+
+static char out_buf[JSON_BUF_SZ];
+static json_buffer out = { out_buf, 0, JSON_BUF_SZ, NULL };
+static json_buffer prefix = { NULL, 0, 0, NULL };
+
+static void
+json_flush(json_buffer *b)
+{
+    if (b->len)
+	fwrite(b->buf, 1, b->len, b->fp);
+    b->len = 0;
+}
+
+static int
+json_grow(json_buffer *b, size_t n)
+{
+    size_t alloc = b->alloc ? b->alloc : 1024;
+    char *buf;
+    while (alloc < b->len + n)
+	alloc *= 2;
+    buf = xrealloc(b->buf, alloc);
+    if (NULL == buf) {
+	syslog(LOG_CRIT, "%s", "Cant output JSON row due to malloc failure!");
+	return -1;
+    }
+    b->buf = buf;
+    b->alloc = alloc;
+    return 0;
+}
+
+static void
+json_put(json_buffer *b, const char *s, size_t n)
+{
+    if (b->len + n > b->alloc && NULL == b->fp && json_grow(b, n) < 0)
+	return;
+    while (n) {
+	size_t k;
+	if (b->len == b->alloc)
+	    json_flush(b);
+	k = b->alloc - b->len;
+	if (k > n)
+	    k = n;
+	memcpy(b->buf + b->len, s, k);
+	b->len += k;
+	s += k;
+	n -= k;
+    }
+}
+
+#define JSON_PUTS(b, s) json_put(b, s, sizeof(s) - 1)
+
+static void
+json_putu64(json_buffer *b, uint64_t v)
+{
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    do {
+	*--p = '0' + v % 10;
+	v /= 10;
+    } while (v);
+    json_put(b, p, tmp + sizeof(tmp) - p);
+}
+
+/* ==== STRINGS =========================================================== */
+
+static unsigned char json_plain[256];
+
+static void
+json_init_plain(void)
+{
+    int c;
+    for (c = 0x20; c < 0x80; c++)
+	json_plain[c] = 1;
+    json_plain['"'] = 0;
+    json_plain['\\'] = 0;
+}
+
+/*
+ * Writes s as a quoted JSON string.  Runs of characters that need no
+ * escaping, which is usually all of them, are copied as they are.
+ */
+static void
+json_put_string(json_buffer *b, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *u = (const unsigned char *) s;
+    if (!json_plain['A'])
+	json_init_plain();
+    JSON_PUTS(b, "\"");
+    for (;;) {
+	const unsigned char *r = u;
+	char esc[6];
+	while (json_plain[*u])
+	    u++;
+	json_put(b, (const char *) r, u - r);
+	if ('\0' == *u)
+	    break;
+	esc[0] = '\\';
+	if ('"' == *u || '\\' == *u) {
+	    esc[1] = *u;
+	    json_put(b, esc, 2);
+	} else {
+	    esc[1] = 'u';
+	    esc[2] = '0';
+	    esc[3] = '0';
+	    esc[4] = hex[*u >> 4];
+	    esc[5] = hex[*u & 0xf];
+	    json_put(b, esc, 6);
+	}
+	u++;
+    }
+    JSON_PUTS(b, "\"");
+}
+
+/* ==== PRINTER =========================================================== */
+
+static const char *array_name;
+static const char *d1_type_s;
+static const char *d2_type_s;
+static int rows;		/* json_rows_printer is printing */
+static int row_cells;		/* cells printed in the current row */
+
+static void
+start_array(void *pr_data, const char *name)
+{
+    FILE *fp = pr_data;
+    assert(fp);
+    if (fp != out.fp) {
+	json_flush(&out);
+	out.fp = fp;
+    }
+    array_name = name;
+}
+
+static void
+finish_array(void *pr_data)
+{
+    json_flush(&out);
+}
+
+static void
+d1_type(void *pr_data, const char *t)
+{
+    d1_type_s = t;
+}
+
+static void
+d2_type(void *pr_data, const char *t)
+{
+    d2_type_s = t;
+}
+
+static void
+start_data(void *pr_data)
+{
+}
+
+static void
+finish_data(void *pr_data)
+{
+}
+
+static void
+d1_begin(void *pr_data, char *l)
+{
+    prefix.len = 0;
+    JSON_PUTS(&prefix, "{\"array\":");
+    json_put_string(&prefix, array_name);
+    JSON_PUTS(&prefix, ",\"start_time\":");
+    json_putu64(&prefix, md_array_print_start_time());
+    JSON_PUTS(&prefix, ",\"stop_time\":");
+    json_putu64(&prefix, md_array_print_finish_time());
+    JSON_PUTS(&prefix, ",\"d1_type\":");
+    json_put_string(&prefix, d1_type_s);
+    JSON_PUTS(&prefix, ",\"d1\":");
+    json_put_string(&prefix, l);
+    JSON_PUTS(&prefix, ",\"d2_type\":");
+    json_put_string(&prefix, d2_type_s);
+    if (rows) {
+	JSON_PUTS(&prefix, ",\"cells\":{");
+	json_put(&out, prefix.buf, prefix.len);
+    } else {
+	JSON_PUTS(&prefix, ",\"d2\":");
+    }
+    row_cells = 0;
+}
+
+static void
+print_element(void *pr_data, char *l, uint64_t val)
+{
+    if (!rows) {
+	json_put(&out, prefix.buf, prefix.len);
+	json_put_string(&out, l);
+	JSON_PUTS(&out, ",\"count\":");
+	json_putu64(&out, val);
+	JSON_PUTS(&out, "}\n");
+	return;
+    }
+    if (row_cells++)
+	JSON_PUTS(&out, ",");
+    json_put_string(&out, l);
+    JSON_PUTS(&out, ":");
+    json_putu64(&out, val);
+}
+
+static void
+d1_end(void *pr_data, char *l)
+{
+    if (rows)
+	JSON_PUTS(&out, "}}\n");
+}
+
+static void
+cells_start_array(void *pr_data, const char *name)
+{
+    rows = 0;
+    start_array(pr_data, name);
+}
+
+static void
+rows_start_array(void *pr_data, const char *name)
+{
+    rows = 1;
+    start_array(pr_data, name);
+}
+
+md_array_printer json_printer =
+{
+    cells_start_array,
+    finish_array,
+    d1_type,
+    d2_type,
+    start_data,
+    finish_data,
+    d1_begin,
+    d1_end,
+    print_element
+};
+
+md_array_printer json_rows_printer =
+{
+    rows_start_array,
+    finish_array,
+    d1_type,
+    d2_type,
+    start_data,
+    finish_data,
+    d1_begin,
+    d1_end,
+    print_element
+};
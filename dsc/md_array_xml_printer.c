@@ -2,11 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <inttypes.h>
 
 #include "dns_message.h"
 #include "md_array.h"
 #include "pcap.h"
-#include "base64.h"
 #include "xmalloc.h"
 
 static const char *d1_type_s;	/* XXX barf */
@@ -14,31 +14,194 @@ static const char *d2_type_s;	/* XXX barf */
 
 static const char *b64 = " base64=\"1\"";
 
+/* ==== OUTPUT BUFFER ===================================================== */
+
+/*
+ * Output is collected here and written out in large pieces, at the
+ * latest at the end of each array, so that whatever the caller
+ * writes to the file between arrays stays in order.
+ */
+#define XML_BUF_SZ 65536
+static char xml_buf[XML_BUF_SZ];
+static size_t xml_len = 0;
+static FILE *xml_fp = NULL;
+
+static void
+xml_flush(void)
+{
+    if (xml_len)
+	fwrite(xml_buf, 1, xml_len, xml_fp);
+    xml_len = 0;
+}
+
+/*
+ * Returns room for n bytes (n <= XML_BUF_SZ) at the end of the buffer.
+ */
+static char *
+xml_room(FILE *fp, size_t n)
+{
+    if (fp != xml_fp) {
+	xml_flush();
+	xml_fp = fp;
+    }
+    if (xml_len + n > XML_BUF_SZ)
+	xml_flush();
+    return xml_buf + xml_len;
+}
+
+static void
+xml_put(FILE *fp, const char *s, size_t n)
+{
+    while (n) {
+	size_t k = n < XML_BUF_SZ ? n : XML_BUF_SZ;
+	memcpy(xml_room(fp, k), s, k);
+	xml_len += k;
+	s += k;
+	n -= k;
+    }
+}
+
+#define XML_PUTS(fp, s) xml_put(fp, s, sizeof(s) - 1)
+
+static void
+xml_putstr(FILE *fp, const char *s)
+{
+    xml_put(fp, s, strlen(s));
+}
+
+static void
+xml_putu64(FILE *fp, uint64_t v)
+{
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    do {
+	*--p = '0' + v % 10;
+	v /= 10;
+    } while (v);
+    xml_put(fp, p, tmp + sizeof(tmp) - p);
+}
+
+static void
+xml_putint(FILE *fp, int v)
+{
+    if (v < 0) {
+	XML_PUTS(fp, "-");
+	xml_putu64(fp, -(int64_t) v);
+    } else {
+	xml_putu64(fp, v);
+    }
+}
+
+/* ==== LABELS ============================================================ */
+
+static const char *entity_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+"0123456789._-:";
+
+static const char base64_chars[] =
+"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static unsigned char entity_ok[256];
+
+static void
+xml_init_entity_ok(void)
+{
+    const char *c;
+    for (c = entity_chars; *c; c++)
+	entity_ok[(unsigned char) *c] = 1;
+}
+
+/*
+ * Labels with characters other than entity_chars are base64 encoded,
+ * straight into the output buffer, as base64_encode() would.
+ */
+static void
+xml_put_base64(FILE *fp, const unsigned char *q, size_t size)
+{
+    while (size) {
+	size_t k = size < 3 * 1024 ? size : 3 * 1024;
+	char *p = xml_room(fp, (k + 2) / 3 * 4);
+	char *s = p;
+	size_t i;
+	for (i = 0; i + 2 < k; i += 3, p += 4) {
+	    unsigned int c = (q[i] << 16) | (q[i + 1] << 8) | q[i + 2];
+	    p[0] = base64_chars[c >> 18];
+	    p[1] = base64_chars[(c >> 12) & 0x3f];
+	    p[2] = base64_chars[(c >> 6) & 0x3f];
+	    p[3] = base64_chars[c & 0x3f];
+	}
+	if (i < k) {
+	    unsigned int c = q[i] << 16;
+	    if (i + 1 < k)
+		c |= q[i + 1] << 8;
+	    p[0] = base64_chars[c >> 18];
+	    p[1] = base64_chars[(c >> 12) & 0x3f];
+	    p[2] = i + 1 < k ? base64_chars[(c >> 6) & 0x3f] : '=';
+	    p[3] = '=';
+	    p += 4;
+	}
+	xml_len += p - s;
+	q += k;
+	size -= k;
+    }
+}
+
+/*
+ * Writes val="label" and, if it had to be encoded, the base64 flag.
+ */
+static void
+xml_put_label(FILE *fp, const char *l)
+{
+    const unsigned char *u = (const unsigned char *) l;
+    size_t ll;
+    int plain = 1;
+    if (!entity_ok['A'])
+	xml_init_entity_ok();
+    for (ll = 0; u[ll]; ll++)
+	plain &= entity_ok[u[ll]];
+    XML_PUTS(fp, " val=\"");
+    if (plain) {
+	xml_put(fp, l, ll);
+	XML_PUTS(fp, "\"");
+    } else {
+	xml_put_base64(fp, u, ll);
+	XML_PUTS(fp, "\"");
+	xml_putstr(fp, b64);
+    }
+}
+
+/* ==== PRINTER =========================================================== */
+
 static void
 start_array(void *pr_data, const char *name)
 {
     FILE *fp = pr_data;
     assert(fp);
-    fprintf(fp, "<array");
-    fprintf(fp, " name=\"%s\"", name);
-    fprintf(fp, " dimensions=\"%d\"", 2);
-    fprintf(fp, " start_time=\"%d\"", Pcap_start_time());
-    fprintf(fp, " stop_time=\"%d\"", Pcap_finish_time());
-    fprintf(fp, ">\n");
+    XML_PUTS(fp, "<array name=\"");
+    xml_putstr(fp, name);
+    XML_PUTS(fp, "\" dimensions=\"");
+    xml_putint(fp, 2);
+    XML_PUTS(fp, "\" start_time=\"");
+    xml_putint(fp, md_array_print_start_time());
+    XML_PUTS(fp, "\" stop_time=\"");
+    xml_putint(fp, md_array_print_finish_time());
+    XML_PUTS(fp, "\">\n");
 }
 
 static void
 finish_array(void *pr_data)
 {
     FILE *fp = pr_data;
-    fprintf(fp, "</array>\n");
+    XML_PUTS(fp, "</array>\n");
+    xml_flush();
 }
 
 static void
 d1_type(void *pr_data, const char *t)
 {
     FILE *fp = pr_data;
-    fprintf(fp, "  <dimension number=\"1\" type=\"%s\"/>\n", t);
+    XML_PUTS(fp, "  <dimension number=\"1\" type=\"");
+    xml_putstr(fp, t);
+    XML_PUTS(fp, "\"/>\n");
     d1_type_s = t;
 }
 
@@ -46,67 +209,55 @@ static void
 d2_type(void *pr_data, const char *t)
 {
     FILE *fp = pr_data;
-    fprintf(fp, "  <dimension number=\"2\" type=\"%s\"/>\n", t);
+    XML_PUTS(fp, "  <dimension number=\"2\" type=\"");
+    xml_putstr(fp, t);
+    XML_PUTS(fp, "\"/>\n");
     d2_type_s = t;
 }
 
-static const char *entity_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
-"0123456789._-:";
-
 static void
 d1_begin(void *pr_data, char *l)
 {
     FILE *fp = pr_data;
-    int ll = strlen(l);
-    char *e = NULL;
-    if (strspn(l, entity_chars) != ll) {
-	int x = base64_encode(l, ll, &e);
-	assert(x);
-	l = e;
-    }
-    fprintf(fp, "    <%s val=\"%s\"%s>\n", d1_type_s, l, e ? b64 : "");
-    if (e)
-	xfree(e);
+    XML_PUTS(fp, "    <");
+    xml_putstr(fp, d1_type_s);
+    xml_put_label(fp, l);
+    XML_PUTS(fp, ">\n");
 }
 
 static void
-print_element(void *pr_data, char *l, int val)
+print_element(void *pr_data, char *l, uint64_t val)
 {
     FILE *fp = pr_data;
-    int ll = strlen(l);
-    char *e = NULL;
-    if (strspn(l, entity_chars) != ll) {
-	int x = base64_encode(l, ll, &e);
-	assert(x);
-	l = e;
-    }
-    fprintf(fp, "      <%s", d2_type_s);
-    fprintf(fp, " val=\"%s\"%s", l, e ? b64 : "");
-    fprintf(fp, " count=\"%d\"", val);
-    fprintf(fp, "/>\n");
-    if (e)
-	xfree(e);
+    XML_PUTS(fp, "      <");
+    xml_putstr(fp, d2_type_s);
+    xml_put_label(fp, l);
+    XML_PUTS(fp, " count=\"");
+    xml_putu64(fp, val);
+    XML_PUTS(fp, "\"/>\n");
 }
 
 static void
 d1_end(void *pr_data, char *l)
 {
     FILE *fp = pr_data;
-    fprintf(fp, "    </%s>\n", d1_type_s);
+    XML_PUTS(fp, "    </");
+    xml_putstr(fp, d1_type_s);
+    XML_PUTS(fp, ">\n");
 }
 
 static void
 start_data(void *pr_data)
 {
     FILE *fp = pr_data;
-    fprintf(fp, "  <data>\n");
+    XML_PUTS(fp, "  <data>\n");
 }
 
 static void
 finish_data(void *pr_data)
 {
     FILE *fp = pr_data;
-    fprintf(fp, "  </data>\n");
+    XML_PUTS(fp, "  </data>\n");
 }
 
 md_array_printer xml_printer =
@@ -0,0 +1,436 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <signal.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <inttypes.h>
+
+#include "dataset_opt.h"
+#include "md_array.h"
+#include "snapshot.h"
+#include "live.h"
+#include "xmalloc.h"
+#include "metrics.h"
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+static char *listen_addr = NULL;
+static int listen_fd = -1;
+
+/*
+ * What is known about the last interval written.  Set by the writer
+ * thread, read by the listener, never touched by the packet path.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static char *stats_text = NULL;	/* the statistics arrays, formatted */
+static double write_secs = 0;
+static int last_finish = 0;
+static uint64_t intervals_written = 0;
+static uint64_t intervals_failed = 0;
+
+/* ==== STATISTICS ARRAYS ================================================= */
+
+/*
+ * Formats arrays as gauges: arena_stats with cell ("ALL", "chunks")
+ * becomes dsc_arena_stats{statistic="chunks"}.  The first dimension
+ * is left out when it is "All".
+ */
+static const char *array_name;
+static const char *d1_type_s;
+static const char *d2_type_s;
+static const char *d1_label;
+
+static void
+metrics_name(FILE *fp, const char *s)
+{
+    for (; *s; s++)
+	putc(isalnum((unsigned char) *s) ? tolower((unsigned char) *s) : '_', fp);
+}
+
+static void
+metrics_label_value(FILE *fp, const char *s)
+{
+    putc('"', fp);
+    for (; *s; s++) {
+	if ('\\' == *s || '"' == *s)
+	    putc('\\', fp);
+	if ('\n' == *s)
+	    fputs("\\n", fp);
+	else
+	    putc(*s, fp);
+    }
+    putc('"', fp);
+}
+
+static void
+start_array(void *pr_data, const char *name)
+{
+    FILE *fp = pr_data;
+    array_name = name;
+    fputs("# TYPE dsc_", fp);
+    metrics_name(fp, name);
+    fputs(" gauge\n", fp);
+}
+
+static void
+finish_array(void *pr_data)
+{
+}
+
+static void
+d1_type(void *pr_data, const char *t)
+{
+    d1_type_s = t;
+}
+
+static void
+d2_type(void *pr_data, const char *t)
+{
+    d2_type_s = t;
+}
+
+static void
+start_data(void *pr_data)
+{
+}
+
+static void
+finish_data(void *pr_data)
+{
+}
+
+static void
+d1_begin(void *pr_data, char *l)
+{
+    d1_label = l;
+}
+
+static void
+d1_end(void *pr_data, char *l)
+{
+}
+
+static void
+print_element(void *pr_data, char *l, uint64_t val)
+{
+    FILE *fp = pr_data;
+    fputs("dsc_", fp);
+    metrics_name(fp, array_name);
+    putc('{', fp);
+    if (strcmp(d1_type_s, "All")) {
+	metrics_name(fp, d1_type_s);
+	putc('=', fp);
+	metrics_label_value(fp, d1_label);
+	putc(',', fp);
+    }
+    metrics_name(fp, d2_type_s);
+    putc('=', fp);
+    metrics_label_value(fp, l);
+    fprintf(fp, "} %" PRIu64 "\n", val);
+}
+
+static md_array_printer metrics_printer =
+{
+    start_array,
+    finish_array,
+    d1_type,
+    d2_type,
+    start_data,
+    finish_data,
+    d1_begin,
+    d1_end,
+    print_element
+};
+
+/*
+ * Called by the writer thread once an interval's files are written
+ * (or failed to be).
+ */
+void
+metrics_interval(snapshot *s, double secs, int failed)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp;
+    if (listen_fd < 0)
+	return;
+    if ((fp = open_memstream(&buf, &len))) {
+	snapshot_report_recorded(s, &metrics_printer, fp);
+	fclose(fp);
+    }
+    pthread_mutex_lock(&lock);
+    free(stats_text);
+    stats_text = buf;
+    write_secs = secs;
+    last_finish = snapshot_finish_time(s);
+    if (failed)
+	intervals_failed++;
+    else
+	intervals_written++;
+    pthread_mutex_unlock(&lock);
+}
+
+/* ==== EXPOSITION ======================================================== */
+
+static void
+metrics_counter(FILE *fp, const char *name, const char *help, uint64_t val)
+{
+    fprintf(fp, "# TYPE dsc_%s counter\n", name);
+    fprintf(fp, "# HELP dsc_%s %s\n", name, help);
+    fprintf(fp, "dsc_%s_total %" PRIu64 "\n", name, val);
+}
+
+/*
+ * One counter family with a label; zero counts are left out.  If
+ * 'overflow', the last bucket counts values from there on ("256+").
+ */
+static void
+metrics_counters(FILE *fp, const char *name, const char *label,
+    const uint64_t *vals, int n, int overflow)
+{
+    int i;
+    fprintf(fp, "# TYPE dsc_%s counter\n", name);
+    for (i = 0; i < n; i++) {
+	if (0 == vals[i])
+	    continue;
+	fprintf(fp, "dsc_%s_total{%s=\"%d%s\"} %" PRIu64 "\n", name, label, i,
+	    overflow && i == n - 1 ? "+" : "", vals[i]);
+    }
+}
+
+static char *
+metrics_render(size_t *len)
+{
+    char *buf = NULL;
+    live_totals t;
+    FILE *fp = open_memstream(&buf, len);
+    if (NULL == fp)
+	return NULL;
+    live_totals_read(&t);
+    metrics_counter(fp, "packets", "Packets captured.", t.packets);
+    metrics_counter(fp, "queries", "DNS queries.", t.queries);
+    metrics_counter(fp, "responses", "DNS responses.", t.responses);
+    metrics_counter(fp, "drops", "Packets dropped by the kernel.", t.drops);
+    metrics_counters(fp, "responses_by_rcode", "rcode", t.rcode, LIVE_RCODES, 0);
+    metrics_counters(fp, "queries_by_qtype", "qtype", t.qtype, LIVE_QTYPES, 1);
+    metrics_counters(fp, "queries_by_opcode", "opcode", t.opcode, LIVE_OPCODES, 0);
+    fputs("# TYPE dsc_messages_by_transport counter\n", fp);
+    fprintf(fp, "dsc_messages_by_transport_total{transport=\"udp\"} %" PRIu64 "\n", t.udp);
+    fprintf(fp, "dsc_messages_by_transport_total{transport=\"tcp\"} %" PRIu64 "\n", t.tcp);
+    fputs("# TYPE dsc_live_timestamp_seconds gauge\n", fp);
+    fprintf(fp, "dsc_live_timestamp_seconds %u\n", t.sec);
+
+    pthread_mutex_lock(&lock);
+    if (stats_text)
+	fputs(stats_text, fp);
+    fputs("# TYPE dsc_write_seconds gauge\n", fp);
+    fputs("# HELP dsc_write_seconds Time taken to write the last interval's files.\n", fp);
+    fprintf(fp, "dsc_write_seconds %.6f\n", write_secs);
+    fputs("# TYPE dsc_interval_timestamp_seconds gauge\n", fp);
+    fprintf(fp, "dsc_interval_timestamp_seconds %d\n", last_finish);
+    fputs("# TYPE dsc_intervals_written counter\n", fp);
+    fprintf(fp, "dsc_intervals_written_total %" PRIu64 "\n", intervals_written);
+    fputs("# TYPE dsc_intervals_failed counter\n", fp);
+    fprintf(fp, "dsc_intervals_failed_total %" PRIu64 "\n", intervals_failed);
+    pthread_mutex_unlock(&lock);
+    fputs("# EOF\n", fp);
+    fclose(fp);
+    return buf;
+}
+
+/* ==== LISTENER ========================================================== */
+
+static int
+write_all(int fd, const char *buf, size_t n)
+{
+    while (n) {
+	ssize_t x = write(fd, buf, n);
+	if (x < 0 && EINTR == errno)
+	    continue;
+	if (x <= 0)
+	    return -1;
+	buf += x;
+	n -= x;
+    }
+    return 0;
+}
+
+static void
+metrics_respond(int fd, const char *status, const char *type, const char *body, size_t len)
+{
+    char head[256];
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\n"
+	"Content-Type: %s\r\n"
+	"Content-Length: %lu\r\n"
+	"Connection: close\r\n\r\n", status, type, (unsigned long) len);
+    if (write_all(fd, head, n) == 0)
+	write_all(fd, body, len);
+}
+
+/*
+ * Answers one request.  Only GET /metrics (or /) is understood.
+ */
+static void
+metrics_serve(int fd)
+{
+    struct timeval tv = { 5, 0 };
+    char req[4096];
+    size_t n = 0;
+    ssize_t x;
+    char *path;
+    char *body;
+    size_t len;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    while (n < sizeof(req) - 1 && (x = read(fd, req + n, sizeof(req) - 1 - n)) > 0) {
+	n += x;
+	req[n] = '\0';
+	if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+	    break;
+    }
+    req[n] = '\0';
+    if (strncmp(req, "GET ", 4)) {
+	metrics_respond(fd, "405 Method Not Allowed", "text/plain", "GET only\n", 9);
+	return;
+    }
+    path = req + 4;
+    path[strcspn(path, " ?\r\n")] = '\0';
+    if (strcmp(path, "/metrics") && strcmp(path, "/")) {
+	metrics_respond(fd, "404 Not Found", "text/plain", "not found\n", 10);
+	return;
+    }
+    if (NULL == (body = metrics_render(&len))) {
+	metrics_respond(fd, "500 Internal Server Error", "text/plain", "out of memory\n", 14);
+	return;
+    }
+    metrics_respond(fd, "200 OK", METRICS_CONTENT_TYPE, body, len);
+    free(body);
+}
+
+static void *
+metrics_main(void *unused)
+{
+    for (;;) {
+	int fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0) {
+	    if (EINTR != errno && ECONNABORTED != errno) {
+		syslog(LOG_ERR, "metrics accept: %s", strerror(errno));
+		sleep(1);
+	    }
+	    continue;
+	}
+	metrics_serve(fd);
+	close(fd);
+    }
+    return NULL;
+}
+
+/*
+ * A path is a UNIX socket; anything else is host:port (or [v6]:port).
+ */
+static int
+metrics_socket(const char *addr)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+    struct addrinfo *ai;
+    char host[256];
+    char *port;
+    int fd = -1;
+    int x;
+    if ('/' == *addr) {
+	struct sockaddr_un sun;
+	if (strlen(addr) >= sizeof(sun.sun_path)) {
+	    syslog(LOG_ERR, "metrics_listen: %s: path too long", addr);
+	    return -1;
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, addr);
+	unlink(addr);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	    || bind(fd, (struct sockaddr *) &sun, sizeof(sun)) < 0
+	    || listen(fd, 8) < 0) {
+	    syslog(LOG_ERR, "metrics_listen: %s: %s", addr, strerror(errno));
+	    if (fd >= 0)
+		close(fd);
+	    return -1;
+	}
+	return fd;
+    }
+    snprintf(host, sizeof(host), "%s", addr);
+    if (NULL == (port = strrchr(host, ':'))) {
+	syslog(LOG_ERR, "metrics_listen: %s: expected host:port or a path", addr);
+	return -1;
+    }
+    *port++ = '\0';
+    if ('[' == host[0] && ']' == port[-2]) {
+	port[-2] = '\0';
+	memmove(host, host + 1, strlen(host));
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if ((x = getaddrinfo(host, port, &hints, &res))) {
+	syslog(LOG_ERR, "metrics_listen: %s: %s", addr, gai_strerror(x));
+	return -1;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+	int on = 1;
+	if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+	    continue;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (0 == bind(fd, ai->ai_addr, ai->ai_addrlen) && 0 == listen(fd, 8))
+	    break;
+	close(fd);
+	fd = -1;
+    }
+    if (fd < 0)
+	syslog(LOG_ERR, "metrics_listen: %s: %s", addr, strerror(errno));
+    freeaddrinfo(res);
+    return fd;
+}
+
+int
+metrics_set_listen(const char *addr)
+{
+    listen_addr = xstrdup(addr);
+    if (NULL == listen_addr)
+	return 0;
+    live_enable();
+    return 1;
+}
+
+/*
+ * Starts the listener, once dsc has become a daemon.
+ */
+void
+metrics_start(void)
+{
+    pthread_t t;
+    int x;
+    if (NULL == listen_addr)
+	return;
+    if ((listen_fd = metrics_socket(listen_addr)) < 0)
+	exit(1);
+    signal(SIGPIPE, SIG_IGN);
+    if ((x = pthread_create(&t, NULL, metrics_main, NULL))) {
+	syslog(LOG_ERR, "pthread_create: %s", strerror(x));
+	exit(1);
+    }
+    pthread_detach(t);
+}
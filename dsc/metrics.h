@@ -0,0 +1,24 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * OpenMetrics listener (metrics_listen).  A thread of its own answers
+ * HTTP GET requests, on a UNIX socket or a (local) TCP address, with
+ * OpenMetrics text:
+ *
+ * - traffic counters since dsc started, from the live counters
+ *   (live.h), which are read with a seqlock, so the packet path
+ *   takes no locks;
+ * - the statistics arrays (arena_stats, pcap_stats, sample_stats,
+ *   indexer_stats) of the last interval written, as gauges;
+ * - how long writing the last interval's files took, and how many
+ *   intervals were written or failed.
+ */
+
+struct _snapshot;
+
+int metrics_set_listen(const char *addr);
+void metrics_start(void);
+void metrics_interval(struct _snapshot *, double write_secs, int failed);
+
+#endif /* METRICS_H */
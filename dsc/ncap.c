@@ -28,6 +28,8 @@
 #include "ncap.h"
 #include "byteorder.h"
 #include "syslog_debug.h"
+#include "sample.h"
+#include "live.h"
 
 #define NCAP_SNAPLEN 70000
 
@@ -37,6 +39,7 @@ extern void handle_dns(const u_char *buf, uint16_t len, transport_message *tm,
     DMC *dns_message_callback);
 extern int debug_flag;
 extern char *bpf_program_str;	/* from pcap.c */
+extern int report_interval;		/* from config_hooks.c */
 static DMC *dns_message_callback;
 static struct timespec last_ts;
 static struct timespec start_ts;
@@ -53,6 +56,7 @@ handle_ncap(ncap_t nc, void *udata, ncap_msg_ct msg, const char *wtf)
 
     memset(&tm, '\0', sizeof(tm));
     last_ts = msg->ts;
+    live_packets(1);
     if (ncap_ip4 == msg->np) {
         tm.ip_version = 4;
 	inXaddr_assign_v4(&tm.src_ip_addr, &msg->npu.ip4.src);
@@ -73,7 +77,7 @@ handle_ncap(ncap_t nc, void *udata, ncap_msg_ct msg, const char *wtf)
 	tm.dst_port = (u_short) nptohl(&msg->tpu.tcp.dport);
     }
 
-    if (i.proto)
+    if (i.proto && sample_flow(&tm))
 	handle_dns(msg->payload, msg->paylen, &tm, dns_message_callback);
 }
 
@@ -123,16 +127,18 @@ int
 Ncap_run(DMC * dns_callback)
 {
     int result = 1;
-#   define INTERVAL 60
 
     dns_message_callback = dns_callback;
+    sample_begin_interval();
     struct timeval tv;
     gettimeofday(&tv, NULL);
     TIMEVAL_TO_TIMESPEC(&tv, &start_ts);
-    finish_ts.tv_sec = ((start_ts.tv_sec / INTERVAL) + 1) * INTERVAL;
+    finish_ts.tv_sec = ((start_ts.tv_sec / report_interval) + 1) * report_interval;
     finish_ts.tv_nsec = 0;
     while (last_ts.tv_sec < finish_ts.tv_sec) {
 	NC->collect(NC, 1, handle_ncap, NULL);
+	if (live_second_over(last_ts.tv_sec))
+	    live_publish(last_ts.tv_sec, 0);
     }
     return result;
 }
@@ -0,0 +1,308 @@
+#define _GNU_SOURCE		/* for fopencookie() */
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "dataset_opt.h"
+#include "md_array.h"
+#include "xmalloc.h"
+#include "output.h"
+
+extern md_array_printer xml_printer;
+extern md_array_printer binary_printer;
+extern md_array_printer json_printer;
+extern md_array_printer json_rows_printer;
+
+typedef struct {
+    const char *name;		/* for output_format */
+    const char *suffix;
+    md_array_printer *printer;
+    const char *head;
+    const char *tail;
+} output_format;
+
+static output_format formats[] = {
+    { "xml", "xml", &xml_printer, "<dscdata>\n", "</dscdata>\n" },
+    { "binary", "bin", &binary_printer, "DSCB\001", "" },
+    { "json", "jsonl", &json_printer, "", "" },
+    { "json-rows", "jsonl", &json_rows_printer, "", "" },
+    { NULL }
+};
+
+static output_format *format = &formats[0];
+
+typedef struct {
+    const char *name;		/* for output_compression */
+    const char *suffix;
+    FILE *(*fdopen) (int);
+} output_compression;
+
+static FILE *plain_fdopen(int);
+#if HAVE_LIBZ
+static FILE *gzip_fdopen(int);
+#endif
+#if HAVE_LIBZSTD
+static FILE *zstd_fdopen(int);
+#endif
+
+static output_compression compressions[] = {
+    { "none", "", plain_fdopen },
+#if HAVE_LIBZ
+    { "gzip", ".gz", gzip_fdopen },
+#endif
+#if HAVE_LIBZSTD
+    { "zstd", ".zst", zstd_fdopen },
+#endif
+    { NULL }
+};
+
+static output_compression *compression = &compressions[0];
+static char suffix[32] = "xml";
+
+static void
+output_make_suffix(void)
+{
+    snprintf(suffix, sizeof(suffix), "%s%s", format->suffix, compression->suffix);
+}
+
+int
+output_set_format(const char *name)
+{
+    output_format *f;
+    for (f = formats; f->name; f++) {
+	if (0 == strcmp(f->name, name)) {
+	    format = f;
+	    output_make_suffix();
+	    return 1;
+	}
+    }
+    syslog(LOG_ERR, "unknown output_format '%s'", name);
+    return 0;
+}
+
+int
+output_set_compression(const char *name)
+{
+    output_compression *c;
+    for (c = compressions; c->name; c++) {
+	if (0 == strcmp(c->name, name)) {
+	    compression = c;
+	    output_make_suffix();
+	    return 1;
+	}
+    }
+    syslog(LOG_ERR, "unknown or unsupported output_compression '%s'", name);
+    return 0;
+}
+
+md_array_printer *
+output_printer(void)
+{
+    return format->printer;
+}
+
+const char *
+output_suffix(void)
+{
+    return suffix;
+}
+
+/*
+ * Returns a stream that writes (compressed, if so configured) to fd.
+ * fclose() finishes the compressed stream and closes fd.  On failure
+ * fd is left open, for the caller to close.
+ */
+FILE *
+output_fdopen(int fd)
+{
+    return compression->fdopen(fd);
+}
+
+void
+output_begin(FILE *fp)
+{
+    fputs(format->head, fp);
+}
+
+void
+output_end(FILE *fp)
+{
+    fputs(format->tail, fp);
+}
+
+/* ==== COMPRESSION ======================================================= */
+
+static FILE *
+plain_fdopen(int fd)
+{
+    return fdopen(fd, "w");
+}
+
+#if HAVE_LIBZ || HAVE_LIBZSTD
+
+/*
+ * Compressors are hidden behind stdio streams, so the printers do not
+ * need to know about them.
+ */
+#if defined(__GLIBC__)
+#define COOKIE_WRITE(name) static ssize_t name(void *cookie, const char *buf, size_t n)
+typedef ssize_t cookie_write_fn(void *, const char *, size_t);
+#else
+#define COOKIE_WRITE(name) static int name(void *cookie, const char *buf, int n)
+typedef int cookie_write_fn(void *, const char *, int);
+#endif
+
+static FILE *
+cookie_fopen(void *cookie, cookie_write_fn *writefn, int (*closefn) (void *))
+{
+#if defined(__GLIBC__)
+    cookie_io_functions_t io = { NULL, writefn, NULL, closefn };
+    return fopencookie(cookie, "w", io);
+#else
+    return funopen(cookie, NULL, writefn, NULL, closefn);
+#endif
+}
+
+#endif
+
+#if HAVE_LIBZ
+
+COOKIE_WRITE(gzip_write)
+{
+    if (0 == n)
+	return 0;
+    return gzwrite(cookie, buf, n) > 0 ? n : -1;
+}
+
+static int
+gzip_close(void *cookie)
+{
+    return Z_OK == gzclose(cookie) ? 0 : -1;
+}
+
+static FILE *
+gzip_fdopen(int fd)
+{
+    int gzfd = dup(fd);		/* gzclose() closes it, even on failure */
+    gzFile gz;
+    FILE *fp;
+    if (gzfd < 0)
+	return NULL;
+    if (NULL == (gz = gzdopen(gzfd, "wb"))) {
+	close(gzfd);
+	return NULL;
+    }
+    fp = cookie_fopen(gz, gzip_write, gzip_close);
+    if (NULL == fp) {
+	gzclose(gz);
+	return NULL;
+    }
+    close(fd);
+    return fp;
+}
+
+#endif
+
+#if HAVE_LIBZSTD
+
+typedef struct {
+    ZSTD_CCtx *cctx;
+    int fd;
+    void *buf;
+    size_t bufsz;
+} zstd_stream;
+
+static int
+write_all(int fd, const char *buf, size_t n)
+{
+    while (n) {
+	ssize_t x = write(fd, buf, n);
+	if (x < 0 && EINTR == errno)
+	    continue;
+	if (x < 0)
+	    return -1;
+	buf += x;
+	n -= x;
+    }
+    return 0;
+}
+
+/*
+ * Compresses all of 'in' (and with ZSTD_e_end, the rest of the frame).
+ */
+static int
+zstd_compress(zstd_stream *z, ZSTD_inBuffer *in, ZSTD_EndDirective end)
+{
+    size_t left;
+    do {
+	ZSTD_outBuffer out = { z->buf, z->bufsz, 0 };
+	left = ZSTD_compressStream2(z->cctx, &out, in, end);
+	if (ZSTD_isError(left))
+	    return -1;
+	if (write_all(z->fd, out.dst, out.pos) < 0)
+	    return -1;
+    } while (ZSTD_e_end == end ? left != 0 : in->pos < in->size);
+    return 0;
+}
+
+COOKIE_WRITE(zstd_write)
+{
+    ZSTD_inBuffer in = { buf, n, 0 };
+    return zstd_compress(cookie, &in, ZSTD_e_continue) < 0 ? -1 : n;
+}
+
+static void
+zstd_free(zstd_stream *z)
+{
+    ZSTD_freeCCtx(z->cctx);
+    xfree(z->buf);
+    xfree(z);
+}
+
+static int
+zstd_close(void *cookie)
+{
+    zstd_stream *z = cookie;
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+    int x = zstd_compress(z, &in, ZSTD_e_end);
+    if (close(z->fd) < 0)
+	x = -1;
+    zstd_free(z);
+    return x;
+}
+
+static FILE *
+zstd_fdopen(int fd)
+{
+    zstd_stream *z = xcalloc(1, sizeof(*z));
+    FILE *fp;
+    if (NULL == z)
+	return NULL;
+    z->fd = fd;
+    z->bufsz = ZSTD_CStreamOutSize();
+    z->buf = xmalloc(z->bufsz);
+    z->cctx = ZSTD_createCCtx();
+    if (NULL == z->buf || NULL == z->cctx) {
+	zstd_free(z);
+	return NULL;
+    }
+    fp = cookie_fopen(z, zstd_write, zstd_close);
+    if (NULL == fp)
+	zstd_free(z);
+    return fp;
+}
+
+#endif
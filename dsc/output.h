@@ -0,0 +1,21 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+/*
+ * Data file formats.  Each format has a printer for the arrays, a
+ * file name suffix, and whatever goes at the beginning and end of a
+ * file around the arrays.  Files may be compressed (gzip or zstd, if
+ * dsc was built with zlib or libzstd) as they are written.
+ */
+
+struct _md_array_printer;
+
+int output_set_format(const char *name);
+int output_set_compression(const char *name);
+struct _md_array_printer *output_printer(void);
+const char *output_suffix(void);
+FILE *output_fdopen(int fd);
+void output_begin(FILE *);
+void output_end(FILE *);
+
+#endif /* OUTPUT_H */
@@ -45,6 +45,8 @@
 #include "byteorder.h"
 #include "syslog_debug.h"
 #include "hashtbl.h"
+#include "sample.h"
+#include "live.h"
 
 #define PCAP_SNAPLEN 65536
 #ifndef ETHER_HDR_LEN
@@ -119,6 +121,7 @@ int vlan_tag_needs_byte_conversion = 1;
 extern void handle_dns(const u_char *buf, uint16_t len, transport_message *tm,
     DMC *dns_message_callback);
 extern int debug_flag;
+extern int report_interval;		/* from config_hooks.c */
 #if 0
 static int debug_count = 20;
 #endif
@@ -139,6 +142,8 @@ handle_udp(const struct udphdr *udp, int len, transport_message *tm)
 
     if (port53 != tm->dst_port && port53 != tm->src_port)
 	return;
+    if (!sample_flow(tm))
+	return;
     handle_dns((void *)(udp + 1), len - sizeof(*udp), tm, dns_message_callback);
 }
 
@@ -237,9 +242,8 @@ static unsigned int
 tcp_hashfunc(const void *key)
 {
     tcpHashkey_t *k = (tcpHashkey_t *) key;
-    return (k->dport << 16) | k->sport |
-	k->src_ip_addr._.in4.s_addr | k->dst_ip_addr._.in4.s_addr;
-    /* 32 low bits of ipv6 address are good enough for a hash */
+    return (inXaddr_hash(&k->src_ip_addr) * 31 + inXaddr_hash(&k->dst_ip_addr)) ^
+	((k->dport << 16) | k->sport);
 }
 
 static int
@@ -560,6 +564,8 @@ handle_tcp(const struct tcphdr *tcp, int len, transport_message *tm)
 
     if (port53 != key.dport && port53 != key.sport)
 	return;
+    if (!sample_flow(tm))
+	return;		/* the whole stream is skipped */
 
     if (NULL == tcpHash) {
         tcpHash = hash_create(MAX_TCP_STATE, tcp_hashfunc, tcp_cmpfunc, 0,
@@ -1048,21 +1054,38 @@ Pcap_init(const char *device, int promisc)
     }
 }
 
+/*
+ * The kernel's drops on all interfaces so far, for the live counters.
+ */
+static uint64_t
+pcap_drops_total(void)
+{
+    struct pcap_stat ps;
+    uint64_t d = 0;
+    int i;
+    for (i = 0; i < n_interfaces; i++)
+	if (0 == pcap_stats(interfaces[i].pcap, &ps))
+	    d += ps.ps_drop;
+    return d;
+}
+
 int
 Pcap_run(DMC * dns_callback)
 {
     int i;
     int result = 1;
-#   define INTERVAL 60
+    uint64_t received = 0;
+    uint64_t dropped = 0;
 
     dns_message_callback = dns_callback;
     for (i = 0; i < n_interfaces; i++)
 	interfaces[i].pkts_captured = 0;
+    sample_begin_interval();
     if (n_pcap_offline > 0) {
 	result = 0;
 	if (finish_ts.tv_sec > 0) {
 	    start_ts.tv_sec = finish_ts.tv_sec;
-	    finish_ts.tv_sec += INTERVAL;
+	    finish_ts.tv_sec += report_interval;
 	}
 	do {
 	    result = pcap_dispatch(interfaces[0].pcap, 1, handle_pcap,
@@ -1070,9 +1093,12 @@ Pcap_run(DMC * dns_callback)
 	    if (result <= 0) /* error or EOF */
 		break;
 	    interfaces[0].pkts_captured += result;
+	    live_packets(result);
+	    if (live_second_over(last_ts.tv_sec))
+		live_publish(last_ts.tv_sec, 0);
 	    if (start_ts.tv_sec == 0) {
 		start_ts = last_ts;
-		finish_ts.tv_sec = ((start_ts.tv_sec / INTERVAL) + 1) * INTERVAL;
+		finish_ts.tv_sec = ((start_ts.tv_sec / report_interval) + 1) * report_interval;
 		finish_ts.tv_usec = 0;
 	    }
 	} while (last_ts.tv_sec < finish_ts.tv_sec);
@@ -1080,7 +1106,7 @@ Pcap_run(DMC * dns_callback)
 	    finish_ts = last_ts; /* finish was cut short */
     } else {
 	gettimeofday(&start_ts, NULL);
-	finish_ts.tv_sec = ((start_ts.tv_sec / INTERVAL) + 1) * INTERVAL;
+	finish_ts.tv_sec = ((start_ts.tv_sec / report_interval) + 1) * report_interval;
 	finish_ts.tv_usec = 0;
 	while (last_ts.tv_sec < finish_ts.tv_sec) {
 	    fd_set *R = Pcap_select(&pcap_fdset, 0, 250000);
@@ -1096,10 +1122,14 @@ Pcap_run(DMC * dns_callback)
 		struct _interface *I = &interfaces[i];
 		if (FD_ISSET(interfaces[i].fd, &pcap_fdset)) {
 		    int x = pcap_dispatch(I->pcap, -1, handle_pcap, (u_char *) I);
-		    if (x > 0)
+		    if (x > 0) {
 			I->pkts_captured += x;
+			live_packets(x);
+		    }
 		}
 	    }
+	    if (live_second_over(last_ts.tv_sec))
+		live_publish(last_ts.tv_sec, pcap_drops_total());
 	}
 	/*
 	 * get pcap stats
@@ -1108,7 +1138,10 @@ Pcap_run(DMC * dns_callback)
 	    struct _interface *I = &interfaces[i];
 	    I->ps0 = I->ps1;
 	    pcap_stats(I->pcap, &I->ps1);
+	    received += I->ps1.ps_recv - I->ps0.ps_recv;
+	    dropped += I->ps1.ps_drop - I->ps0.ps_drop;
 	}
+	sample_adapt(received, dropped);
     }
     tcpList_remove_older_than(last_ts.tv_sec - MAX_TCP_IDLE);
     return result;
@@ -1149,7 +1182,6 @@ pcap_set_match_vlan(int vlan)
 
 int pcap_ifname_iterator(char **);
 int pcap_stat_iterator(char **);
-extern md_array_printer xml_printer;
 
 static indexer_t indexers[] = {
     { "ifname",    NULL, pcap_ifname_iterator, NULL },
@@ -1192,7 +1224,7 @@ pcap_stat_iterator(char **label)
 }
 
 void
-pcap_report(FILE *fp)
+pcap_report(md_array_printer *pr, FILE *fp)
 {
     int i;
     md_array *theArray = acalloc(1, sizeof(*theArray));
@@ -1207,10 +1239,10 @@ pcap_report(FILE *fp)
     for (i=0; i < n_interfaces; i++) {
 	struct _interface *I = &interfaces[i];
 	theArray->array[i].alloc_sz = 3;
-	theArray->array[i].array = acalloc(3, sizeof(int));
+	theArray->array[i].array = acalloc(3, sizeof(uint64_t));
 	theArray->array[i].array[0] = I->pkts_captured;
 	theArray->array[i].array[1] = I->ps1.ps_recv - I->ps0.ps_recv;
 	theArray->array[i].array[2] = I->ps1.ps_drop - I->ps0.ps_drop;
     }
-    md_array_print(theArray, &xml_printer, fp);
+    md_array_print(theArray, pr, fp);
 }
@@ -4,4 +4,5 @@ int Pcap_run(DMC *);
 void Pcap_close(void);
 int Pcap_start_time(void);
 int Pcap_finish_time(void);
-void pcap_report(FILE*);
+struct _md_array_printer;
+void pcap_report(struct _md_array_printer *, FILE*);
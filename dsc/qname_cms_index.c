@@ -0,0 +1,327 @@
+#include "config.h"
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xmalloc.h"
+#include "dns_message.h"
+#include "md_array.h"
+#include "hashtbl.h"
+#include "cms.h"
+
+/*
+ * Fixed memory variants of the qname, second_ld and third_ld indexers.
+ *
+ * Every name is counted in a Count-Min sketch, but only CMS_SLOTS
+ * names get an index of their own.  When all slots are taken, a name
+ * whose estimate exceeds that of the smallest slot takes the slot
+ * over, and the cells already counted for the slot are credited to the
+ * new name (as in Space-Saving).  Everything else goes to the
+ * "-:OTHER:-" index.  The sketch error and the largest count handed
+ * over are reported through the stats function.
+ */
+
+#define CMS_SLOTS 1000
+#define CMS_WIDTH 8192
+#define CMS_DEPTH 4
+#define OTHER_IDX 0		/* slot i has index i + 1 */
+
+typedef struct {
+	char name[MAX_QNAME_SZ];
+	uint32_t est;		/* sketch estimate when last seen */
+	unsigned int heap_pos;
+} cmsslot;
+
+typedef struct {
+	count_min *cms;
+	hashtbl *hash;		/* name -> slot */
+	cmsslot *slots;
+	unsigned int *heap;	/* slot numbers, min-heap on est */
+	unsigned int used;
+	uint64_t evictions;
+	uint32_t handed_over;	/* largest est of an evicted slot */
+	int next_iter;
+	int next_stat;
+} cmslevel;
+
+static hashfunc name_hashfunc;
+static hashkeycmp name_cmpfunc;
+static int cms_indexer(const char *, cmslevel *);
+static int cms_iterator(char **, cmslevel *);
+static void cms_reset(cmslevel *);
+static int cms_stats(char **, uint64_t *, cmslevel *);
+
+static cmslevel Full;
+static cmslevel Second;
+static cmslevel Third;
+
+/* ==== QNAME ============================================================= */
+
+int
+qname_cms_indexer(const void *vp)
+{
+    const dns_message *m = vp;
+    if (m->malformed)
+	return -1;
+    return cms_indexer(m->qname, &Full);
+}
+
+int
+qname_cms_iterator(char **label)
+{
+    return cms_iterator(label, &Full);
+}
+
+void
+qname_cms_reset()
+{
+    cms_reset(&Full);
+}
+
+int
+qname_cms_stats(char **label, uint64_t *val)
+{
+    return cms_stats(label, val, &Full);
+}
+
+/* ==== SECOND LEVEL DOMAIN =============================================== */
+
+int
+second_ld_cms_indexer(const void *vp)
+{
+    const dns_message *m = vp;
+    if (m->malformed)
+	return -1;
+    return cms_indexer(dns_message_QnameToNld(m->qname, 2), &Second);
+}
+
+int
+second_ld_cms_iterator(char **label)
+{
+    return cms_iterator(label, &Second);
+}
+
+void
+second_ld_cms_reset()
+{
+    cms_reset(&Second);
+}
+
+int
+second_ld_cms_stats(char **label, uint64_t *val)
+{
+    return cms_stats(label, val, &Second);
+}
+
+/* ==== THIRD LEVEL DOMAIN ================================================ */
+
+int
+third_ld_cms_indexer(const void *vp)
+{
+    const dns_message *m = vp;
+    if (m->malformed)
+	return -1;
+    return cms_indexer(dns_message_QnameToNld(m->qname, 3), &Third);
+}
+
+int
+third_ld_cms_iterator(char **label)
+{
+    return cms_iterator(label, &Third);
+}
+
+void
+third_ld_cms_reset()
+{
+    cms_reset(&Third);
+}
+
+int
+third_ld_cms_stats(char **label, uint64_t *val)
+{
+    return cms_stats(label, val, &Third);
+}
+
+/* ======================================================================== */
+
+static void
+heap_swap(cmslevel *l, unsigned int a, unsigned int b)
+{
+    unsigned int t = l->heap[a];
+    l->heap[a] = l->heap[b];
+    l->heap[b] = t;
+    l->slots[l->heap[a]].heap_pos = a;
+    l->slots[l->heap[b]].heap_pos = b;
+}
+
+static void
+heap_sift_up(cmslevel *l, unsigned int i)
+{
+    while (i > 0) {
+	unsigned int parent = (i - 1) / 2;
+	if (l->slots[l->heap[parent]].est <= l->slots[l->heap[i]].est)
+	    break;
+	heap_swap(l, i, parent);
+	i = parent;
+    }
+}
+
+static void
+heap_sift_down(cmslevel *l, unsigned int i)
+{
+    for (;;) {
+	unsigned int c = 2 * i + 1;
+	if (c >= l->used)
+	    break;
+	if (c + 1 < l->used && l->slots[l->heap[c + 1]].est < l->slots[l->heap[c]].est)
+	    c++;
+	if (l->slots[l->heap[i]].est <= l->slots[l->heap[c]].est)
+	    break;
+	heap_swap(l, i, c);
+	i = c;
+    }
+}
+
+static int
+cms_init(cmslevel *l)
+{
+    l->cms = cms_create(CMS_WIDTH, CMS_DEPTH);
+    l->slots = xcalloc(CMS_SLOTS, sizeof(*l->slots));
+    l->heap = xcalloc(CMS_SLOTS, sizeof(*l->heap));
+    if (NULL == l->cms || NULL == l->slots || NULL == l->heap)
+	return 0;
+    return 1;
+}
+
+static int
+cms_indexer(const char *theName, cmslevel *l)
+{
+    cmsslot *slot;
+    uint32_t pc = 0;
+    uint32_t pb = 0;
+    uint32_t est;
+    unsigned int s;
+
+    if (NULL == l->cms && !cms_init(l))
+	return -1;
+    if (NULL == l->hash) {
+	/* not in the arena; slots are recycled, so this never grows */
+	l->hash = hash_create(CMS_SLOTS, name_hashfunc, name_cmpfunc,
+	    0, NULL, NULL);
+	if (NULL == l->hash)
+	    return -1;
+    }
+    hashlittle2(theName, strlen(theName), &pc, &pb);
+    est = cms_add(l->cms, ((uint64_t) pc << 32) | pb, 1);
+    if ((slot = hash_find(theName, l->hash))) {
+	slot->est = est;
+	heap_sift_down(l, slot->heap_pos);
+	return slot - l->slots + 1;
+    }
+    if (l->used < CMS_SLOTS) {
+	s = l->used++;
+	l->heap[s] = s;
+	l->slots[s].heap_pos = s;
+    } else {
+	s = l->heap[0];
+	if (est <= l->slots[s].est)
+	    return OTHER_IDX;
+	hash_remove(l->slots[s].name, l->hash);
+	if (l->slots[s].est > l->handed_over)
+	    l->handed_over = l->slots[s].est;
+	l->evictions++;
+    }
+    slot = &l->slots[s];
+    snprintf(slot->name, MAX_QNAME_SZ, "%s", theName);
+    slot->est = est;
+    if (0 != hash_add(slot->name, slot, l->hash))
+	return -1;
+    heap_sift_up(l, slot->heap_pos);
+    heap_sift_down(l, slot->heap_pos);
+    return s + 1;
+}
+
+static int
+cms_iterator(char **label, cmslevel *l)
+{
+    static char label_buf[MAX_QNAME_SZ];
+    if (0 == l->used)
+	return -1;
+    if (NULL == label) {
+	l->next_iter = 0;
+	return l->used + 1;
+    }
+    if (l->next_iter > l->used)
+	return -1;
+    if (OTHER_IDX == l->next_iter)
+	snprintf(label_buf, MAX_QNAME_SZ, "%s", "-:OTHER:-");
+    else
+	snprintf(label_buf, MAX_QNAME_SZ, "%s", l->slots[l->next_iter - 1].name);
+    *label = label_buf;
+    return l->next_iter++;
+}
+
+static void
+cms_reset(cmslevel *l)
+{
+    if (l->hash)
+	hash_destroy(l->hash);
+    l->hash = NULL;
+    if (l->cms)
+	cms_clear(l->cms);
+    l->used = 0;
+    l->evictions = 0;
+    l->handed_over = 0;
+}
+
+/*
+ * Called with a NULL label to start over, then returns one statistic
+ * per call until it returns -1.
+ */
+static int
+cms_stats(char **label, uint64_t *val, cmslevel *l)
+{
+    static char *names[] = { "names", "slots", "evictions",
+	"handed_over", "error_bound", NULL };
+    if (NULL == label) {
+	l->next_stat = 0;
+	return 0;
+    }
+    if (NULL == l->cms || NULL == names[l->next_stat])
+	return -1;
+    switch (l->next_stat) {
+    case 0:
+	*val = l->cms->total;
+	break;
+    case 1:
+	*val = l->used;
+	break;
+    case 2:
+	*val = l->evictions;
+	break;
+    case 3:
+	*val = l->handed_over;
+	break;
+    case 4:
+	*val = cms_error_bound(l->cms);
+	break;
+    }
+    *label = names[l->next_stat++];
+    return 0;
+}
+
+static unsigned int
+name_hashfunc(const void *key)
+{
+        return hashendian(key, strlen(key), 0);
+}
+
+static int
+name_cmpfunc(const void *a, const void *b)
+{
+        return strcasecmp(a, b);
+}
@@ -0,0 +1,12 @@
+int qname_cms_indexer(const void *);
+int qname_cms_iterator(char **label);
+void qname_cms_reset(void);
+int qname_cms_stats(char **label, uint64_t *val);
+int second_ld_cms_indexer(const void *);
+int second_ld_cms_iterator(char **label);
+void second_ld_cms_reset(void);
+int second_ld_cms_stats(char **label, uint64_t *val);
+int third_ld_cms_indexer(const void *);
+int third_ld_cms_iterator(char **label);
+void third_ld_cms_reset(void);
+int third_ld_cms_stats(char **label, uint64_t *val);
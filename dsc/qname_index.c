@@ -7,26 +7,30 @@
 #include "dns_message.h"
 #include "md_array.h"
 #include "hashtbl.h"
+#include "hll.h"
+#include "index_limit.h"
+#include "qname_pool.h"
 
 typedef struct {
+	int level;		/* in qname_suffixes */
 	int next_idx;
 	hashtbl *hash;
+	index_limit limit;
 } levelobj;
 
-static hashfunc name_hashfunc;
 static hashkeycmp name_cmpfunc;
-static int name_indexer(const char *, levelobj *);
+static int name_indexer(const dns_message *, levelobj *);
 static int name_iterator(char **, levelobj *);
 static void name_reset(levelobj *);
 
 #define MAX_ARRAY_SZ 65536
 
-static levelobj Full = { 0, NULL };
-static levelobj Second = { 0, NULL };
-static levelobj Third = { 0, NULL };
+static levelobj Full = { 0, 0, NULL };
+static levelobj Second = { 2, 0, NULL };
+static levelobj Third = { 3, 0, NULL };
 
 typedef struct {
-        char *name;
+        const char *name;	/* in the qname pool */
         int index;
 } nameobj;
 
@@ -39,7 +43,7 @@ qname_indexer(const void *vp)
     const dns_message *m = vp;
     if (m->malformed)
 	return -1;
-    return name_indexer(m->qname, &Full);
+    return name_indexer(m, &Full);
 }
 
 int
@@ -54,6 +58,28 @@ qname_reset()
     name_reset(&Full);
 }
 
+void
+qname_max_keys(int max_keys)
+{
+    index_limit_set(&Full.limit, max_keys);
+}
+
+int
+qname_stats(char **label, uint64_t *val)
+{
+    return index_limit_stats(&Full.limit, Full.next_idx, label, val);
+}
+
+int
+qname_hasher(const void *vp, uint64_t *hash)
+{
+    const dns_message *m = vp;
+    if (m->malformed)
+	return -1;
+    *hash = hll_hash(m->qname, strlen(m->qname));
+    return 0;
+}
+
 /* ==== SECOND LEVEL DOMAIN =============================================== */
 
 int
@@ -62,7 +88,7 @@ second_ld_indexer(const void *vp)
     const dns_message *m = vp;
     if (m->malformed)
 	return -1;
-    return name_indexer(dns_message_QnameToNld(m->qname, 2), &Second);
+    return name_indexer(m, &Second);
 }
 
 int
@@ -77,6 +103,30 @@ second_ld_reset()
     name_reset(&Second);
 }
 
+void
+second_ld_max_keys(int max_keys)
+{
+    index_limit_set(&Second.limit, max_keys);
+}
+
+int
+second_ld_stats(char **label, uint64_t *val)
+{
+    return index_limit_stats(&Second.limit, Second.next_idx, label, val);
+}
+
+int
+second_ld_hasher(const void *vp, uint64_t *hash)
+{
+    const dns_message *m = vp;
+    const char *name;
+    if (m->malformed)
+	return -1;
+    name = dns_message_QnameToNld(m->qname, 2);
+    *hash = hll_hash(name, strlen(name));
+    return 0;
+}
+
 /* ==== QNAME ============================================================= */
 
 int
@@ -85,7 +135,7 @@ third_ld_indexer(const void *vp)
     const dns_message *m = vp;
     if (m->malformed)
 	return -1;
-    return name_indexer(dns_message_QnameToNld(m->qname, 3), &Third);
+    return name_indexer(m, &Third);
 }
 
 int
@@ -100,34 +150,63 @@ third_ld_reset()
     name_reset(&Third);
 }
 
+void
+third_ld_max_keys(int max_keys)
+{
+    index_limit_set(&Third.limit, max_keys);
+}
+
+int
+third_ld_stats(char **label, uint64_t *val)
+{
+    return index_limit_stats(&Third.limit, Third.next_idx, label, val);
+}
+
+int
+third_ld_hasher(const void *vp, uint64_t *hash)
+{
+    const dns_message *m = vp;
+    const char *name;
+    if (m->malformed)
+	return -1;
+    name = dns_message_QnameToNld(m->qname, 3);
+    *hash = hll_hash(name, strlen(name));
+    return 0;
+}
+
 /* ======================================================================== */
 
 static int
-name_indexer(const char *theName, levelobj *theLevel)
+name_indexer(const dns_message *m, levelobj *theLevel)
 {
+    const qname_suffixes *s = qname_pool_suffixes(m);
+    const char *theName = s->name[theLevel->level];
+    unsigned int hash = s->hash[theLevel->level];
     nameobj *obj;
     if (NULL == theLevel->hash) {
-        theLevel->hash = hash_create(MAX_ARRAY_SZ, name_hashfunc, name_cmpfunc,
-	    1, afree, afree);
+        theLevel->hash = hash_create(MAX_ARRAY_SZ, qname_pool_hash, name_cmpfunc,
+	    1, NULL, afree);
 	if (NULL == theLevel->hash)
 	    return -1;
     }
-    if ((obj = hash_find(theName, theLevel->hash)))
+    if ((obj = hash_find_hashed(theName, hash, theLevel->hash)))
         return obj->index;
+    if (index_limit_reached(&theLevel->limit, theLevel->next_idx))
+	return theLevel->limit.max_keys;
     obj = acalloc(1, sizeof(*obj));
     if (NULL == obj)
 	return -1;
-    obj->name = astrdup(theName);
+    obj->name = qname_pool_intern(m, theName);
     if (NULL == obj->name) {
 	afree(obj);
 	return -1;
     }
     obj->index = theLevel->next_idx;
-    if (0 != hash_add(obj->name, obj, theLevel->hash)) {
-	afree(obj->name);
+    if (0 != hash_add_hashed(obj->name, hash, obj, theLevel->hash)) {
 	afree(obj);
 	return -1;
     }
+    theLevel->limit.bytes += sizeof(*obj) + HASH_ITEM_BYTES;
     theLevel->next_idx++;
     return obj->index;
 }
@@ -141,10 +220,11 @@ name_iterator(char **label, levelobj *theLevel)
 	return -1;
     if (NULL == label) {
 	hash_iter_init(theLevel->hash);
-	return theLevel->next_idx;
+	index_limit_iter_init(&theLevel->limit);
+	return theLevel->next_idx + 1;
     }
     if ((obj = hash_iterate(theLevel->hash)) == NULL)
-	return -1;
+	return index_limit_iterate(&theLevel->limit, label);
     snprintf(label_buf, MAX_QNAME_SZ, "%s", obj->name);
     *label = label_buf;
     return obj->index;
@@ -155,12 +235,8 @@ name_reset(levelobj *theLevel)
 {
     theLevel->hash = NULL;
     theLevel->next_idx = 0;
-}
-
-static unsigned int
-name_hashfunc(const void *key)
-{
-        return hashendian(key, strlen(key), 0);
+    qname_pool_reset();
+    index_limit_reset(&theLevel->limit);
 }
 
 static int
@@ -1,9 +1,18 @@
 int qname_indexer(const void *);
 int qname_iterator(char **label);
 void qname_reset(void);
+void qname_max_keys(int);
+int qname_stats(char **label, uint64_t *val);
+int qname_hasher(const void *, uint64_t *);
 int second_ld_indexer(const void *);
 int second_ld_iterator(char **label);
 void second_ld_reset(void);
+void second_ld_max_keys(int);
+int second_ld_stats(char **label, uint64_t *val);
+int second_ld_hasher(const void *, uint64_t *);
 int third_ld_indexer(const void *);
 int third_ld_iterator(char **label);
 void third_ld_reset(void);
+void third_ld_max_keys(int);
+int third_ld_stats(char **label, uint64_t *val);
+int third_ld_hasher(const void *, uint64_t *);
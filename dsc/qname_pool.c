@@ -0,0 +1,118 @@
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xmalloc.h"
+#include "dns_message.h"
+#include "md_array.h"
+#include "hashtbl.h"
+#include "qname_pool.h"
+
+#define POOL_HASH_SZ 4096
+
+static hashtbl *Pool = NULL;		/* name -> pooled copy */
+static hashkeycmp pool_cmpfunc;
+
+static qname_suffixes Cache;
+static unsigned int cache_serial = 0;
+
+/*
+ * FNV-1a over the name from right to left, so that every suffix's
+ * hash is an intermediate result of hashing the whole name.
+ */
+#define POOL_HASH_INIT 2166136261U
+#define POOL_HASH_STEP(h, c) (((h) ^ (unsigned char) (c)) * 16777619U)
+
+unsigned int
+qname_pool_hash(const void *name)
+{
+    const char *s = name;
+    const char *p = s + strlen(s);
+    unsigned int h = POOL_HASH_INIT;
+    while (p > s) {
+	p--;
+	h = POOL_HASH_STEP(h, *p);
+    }
+    return h;
+}
+
+/*
+ * name[n] is the same as dns_message_QnameToNld(qname, n).
+ */
+const qname_suffixes *
+qname_pool_suffixes(const dns_message *m)
+{
+    const char *p;
+    unsigned int h = POOL_HASH_INIT;
+    int n;
+    if (cache_serial == md_array_message_serial())
+	return &Cache;
+    Cache.name[0] = m->qname;
+    for (n = 1; n < QNAME_POOL_LEVELS; n++)
+	Cache.name[n] = dns_message_QnameToNld(m->qname, n);
+    /* the suffixes start further and further to the left */
+    p = m->qname + strlen(m->qname);
+    for (n = 1; n < QNAME_POOL_LEVELS; n++) {
+	while (p > Cache.name[n]) {
+	    p--;
+	    h = POOL_HASH_STEP(h, *p);
+	}
+	if (p == Cache.name[n])
+	    Cache.hash[n] = h;
+	else
+	    Cache.hash[n] = qname_pool_hash(Cache.name[n]);
+    }
+    while (p > m->qname) {
+	p--;
+	h = POOL_HASH_STEP(h, *p);
+    }
+    Cache.hash[0] = h;
+    cache_serial = md_array_message_serial();
+    return &Cache;
+}
+
+/*
+ * Returns a copy of 'suffix' (one of the message's qname_suffixes)
+ * that lasts until the end of the interval.
+ */
+const char *
+qname_pool_intern(const dns_message *m, const char *suffix)
+{
+    const qname_suffixes *s = qname_pool_suffixes(m);
+    char *pooled;
+    if (NULL == Pool) {
+	Pool = hash_create(POOL_HASH_SZ, qname_pool_hash, pool_cmpfunc,
+	    1, NULL, NULL);
+	if (NULL == Pool)
+	    return NULL;
+    }
+    pooled = hash_find_hashed(m->qname, s->hash[0], Pool);
+    if (NULL == pooled) {
+	pooled = astrdup(m->qname);
+	if (NULL == pooled)
+	    return NULL;
+	if (0 != hash_add_hashed(pooled, s->hash[0], pooled, Pool))
+	    return NULL;
+    }
+    return pooled + (suffix - m->qname);
+}
+
+/*
+ * Called by every user's reset function; the pool lives in the arena.
+ */
+void
+qname_pool_reset(void)
+{
+    Pool = NULL;
+    cache_serial = 0;
+}
+
+static int
+pool_cmpfunc(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
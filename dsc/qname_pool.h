@@ -0,0 +1,27 @@
+#ifndef QNAME_POOL_H
+#define QNAME_POOL_H
+
+/*
+ * Per-interval pool of query names for the qname, second_ld, third_ld
+ * and tld indexers.  A name is stored once, when one of them first
+ * needs to keep it (or a suffix of it); the level dictionaries then
+ * refer to suffixes of the pooled copy instead of keeping their own.
+ *
+ * The hashes of the name and of its 1st, 2nd and 3rd level suffixes
+ * come out of one right-to-left pass over the name, and are computed
+ * once per message however many indexers ask for them.
+ */
+
+#define QNAME_POOL_LEVELS 4	/* 0 is the whole name */
+
+typedef struct {
+    const char *name[QNAME_POOL_LEVELS];	/* into the message's qname */
+    unsigned int hash[QNAME_POOL_LEVELS];
+} qname_suffixes;
+
+const qname_suffixes *qname_pool_suffixes(const dns_message *);
+const char *qname_pool_intern(const dns_message *, const char *suffix);
+unsigned int qname_pool_hash(const void *name);
+void qname_pool_reset(void);
+
+#endif /* QNAME_POOL_H */
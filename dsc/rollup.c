@@ -0,0 +1,351 @@
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xmalloc.h"
+#include "dataset_opt.h"
+#include "md_array.h"
+#include "hashtbl.h"
+#include "rollup.h"
+#include "syslog_debug.h"
+
+#define ROLLUP_HASH_SZ 4096
+
+typedef struct {
+    char *label;
+    int index;
+} labelobj;
+
+typedef struct {
+    hashtbl *hash;		/* label -> labelobj */
+    int next_idx;
+} rollup_dict;
+
+typedef struct _rollup_array {
+    const md_array *base;	/* report interval array it sums up */
+    md_array *sum;
+    rollup_dict d1;
+    rollup_dict d2;
+    struct _rollup_array *next;
+} rollup_array;
+
+struct _rollup_level {
+    int interval;
+    int start;			/* 0 while nothing is folded in */
+    int finish;
+    int due;			/* complete, to be written and cleared */
+    void *arena;		/* everything below lives here */
+    rollup_array *arrays;
+    rollup_level *next;		/* the next longer interval */
+};
+
+static rollup_level *Levels = NULL;
+
+/*
+ * The rolled up arrays' indexers only iterate; they walk the labels of
+ * whichever array is Current.
+ */
+static rollup_array *Current = NULL;
+static int rollup_d1_iterator(char **);
+static int rollup_d2_iterator(char **);
+static indexer_t rollup_indexers[] = {
+    { "rollup_d1", NULL, rollup_d1_iterator, NULL },
+    { "rollup_d2", NULL, rollup_d2_iterator, NULL },
+};
+
+static hashfunc label_hashfunc;
+static hashkeycmp label_cmpfunc;
+
+int
+rollup_add_interval(int secs)
+{
+    rollup_level **lp;
+    rollup_level *l;
+    if (secs <= 0) {
+	syslog(LOG_ERR, "bad rollup_interval %d", secs);
+	return 0;
+    }
+    for (lp = &Levels; *lp && (*lp)->interval < secs; lp = &(*lp)->next);
+    if (*lp && (*lp)->interval == secs)
+	return 1;
+    l = xcalloc(1, sizeof(*l));
+    if (NULL == l)
+	return 0;
+    l->interval = secs;
+    l->next = *lp;
+    *lp = l;
+    return 1;
+}
+
+/*
+ * Each interval must divide the next longer one, or rolled up reports
+ * would not line up with the ones they are made of.
+ */
+int
+rollup_check(int report_interval)
+{
+    rollup_level *l;
+    int prev = report_interval;
+    for (l = Levels; l; l = l->next) {
+	if (l->interval % prev) {
+	    syslog(LOG_ERR, "rollup_interval %d is not a multiple of %d",
+		l->interval, prev);
+	    return 0;
+	}
+	prev = l->interval;
+    }
+    return 1;
+}
+
+static void *
+rollup_enter(rollup_level *l)
+{
+    void *saved = switchArena(l->arena);
+    if (NULL == l->arena)
+	useArena();
+    return saved;
+}
+
+static void
+rollup_leave(rollup_level *l, void *saved)
+{
+    l->arena = switchArena(saved);
+}
+
+static int
+rollup_dict_index(rollup_dict *d, const char *label)
+{
+    labelobj *obj;
+    if (NULL == d->hash) {
+	d->hash = hash_create(ROLLUP_HASH_SZ, label_hashfunc, label_cmpfunc,
+	    1, afree, afree);
+	if (NULL == d->hash)
+	    return -1;
+    }
+    if ((obj = hash_find(label, d->hash)))
+	return obj->index;
+    obj = acalloc(1, sizeof(*obj));
+    if (NULL == obj)
+	return -1;
+    obj->label = astrdup(label);
+    if (NULL == obj->label)
+	return -1;
+    obj->index = d->next_idx;
+    if (0 != hash_add(obj->label, obj, d->hash))
+	return -1;
+    d->next_idx++;
+    return obj->index;
+}
+
+static int
+rollup_dict_iterator(rollup_dict *d, char **label)
+{
+    labelobj *obj;
+    if (0 == d->next_idx)
+	return -1;
+    if (NULL == label) {
+	hash_iter_init(d->hash);
+	return d->next_idx;
+    }
+    if ((obj = hash_iterate(d->hash)) == NULL)
+	return -1;
+    *label = obj->label;
+    return obj->index;
+}
+
+static int
+rollup_d1_iterator(char **label)
+{
+    return rollup_dict_iterator(&Current->d1, label);
+}
+
+static int
+rollup_d2_iterator(char **label)
+{
+    return rollup_dict_iterator(&Current->d2, label);
+}
+
+/*
+ * Finds (or makes) the level's array summing up 'base'.  Must be
+ * called in the level's arena.
+ */
+static rollup_array *
+rollup_array_find(rollup_level *l, const md_array *base)
+{
+    rollup_array **rap;
+    rollup_array *ra;
+    for (rap = &l->arrays; *rap; rap = &(*rap)->next)
+	if ((*rap)->base == base)
+	    return *rap;
+    ra = acalloc(1, sizeof(*ra));
+    if (NULL == ra)
+	return NULL;
+    ra->base = base;
+    ra->sum = acalloc(1, sizeof(*ra->sum));
+    if (NULL == ra->sum)
+	return NULL;
+    ra->sum->name = base->name;
+    ra->sum->d1.type = base->d1.type;
+    ra->sum->d1.indexer = &rollup_indexers[0];
+    ra->sum->d2.type = base->d2.type;
+    ra->sum->d2.indexer = &rollup_indexers[1];
+    ra->sum->opts = base->opts;
+    ra->sum->opts.topk = 0;	/* exact sums of what was reported */
+    *rap = ra;			/* keep the datasets' order */
+    return ra;
+}
+
+static void
+rollup_fold_cell(void *ctx, const char *label1, const char *label2, uint64_t val)
+{
+    rollup_array *ra = ctx;
+    int i1 = rollup_dict_index(&ra->d1, label1);
+    int i2 = rollup_dict_index(&ra->d2, label2);
+    if (i1 < 0 || i2 < 0)
+	return;
+    md_array_add(ra->sum, i1, i2, val);
+}
+
+static void
+rollup_fold_hll(void *ctx, const char *label1, const struct _hll *h)
+{
+    rollup_array *ra = ctx;
+    int i1 = rollup_dict_index(&ra->d1, label1);
+    if (i1 < 0)
+	return;
+    md_array_hll_merge(ra->sum, i1, h);
+}
+
+static void
+rollup_fold_into(rollup_level *l, md_array *a, const md_array *base,
+    int start, int finish)
+{
+    void *saved;
+    rollup_array *ra;
+    saved = rollup_enter(l);
+    ra = rollup_array_find(l, base);
+    if (ra && base->opts.hll)
+	md_array_walk_hll(a, rollup_fold_hll, ra);
+    else if (ra)
+	md_array_walk(a, rollup_fold_cell, ra);
+    rollup_leave(l, saved);
+    if (0 == l->start || start < l->start)
+	l->start = start;
+    if (finish > l->finish)
+	l->finish = finish;
+}
+
+/*
+ * Adds a report interval's array to the shortest rollup interval.
+ */
+void
+rollup_fold(md_array *a, int start, int finish)
+{
+    if (NULL == Levels)
+	return;
+    rollup_fold_into(Levels, a, a, start, finish);
+}
+
+/*
+ * Marks the rollups that are complete at 'finish' (or all of them
+ * when flushing at exit) as due and cascades them into the next
+ * longer interval.  Returns the number of due rollups.
+ */
+int
+rollup_finish(int finish, int flush)
+{
+    rollup_level *l;
+    int n = 0;
+    for (l = Levels; l; l = l->next) {
+	rollup_array *ra;
+	if (0 == l->start)
+	    continue;
+	if (!flush && finish < (l->start / l->interval + 1) * l->interval)
+	    continue;
+	l->due = 1;
+	n++;
+	if (NULL == l->next)
+	    continue;
+	for (ra = l->arrays; ra; ra = ra->next) {
+	    Current = ra;
+	    rollup_fold_into(l->next, ra->sum, ra->base, l->start, l->finish);
+	}
+	Current = NULL;
+    }
+    return n;
+}
+
+/*
+ * Iterates over the due rollups; start with NULL.
+ */
+rollup_level *
+rollup_due(rollup_level *prev)
+{
+    rollup_level *l;
+    for (l = prev ? prev->next : Levels; l; l = l->next)
+	if (l->due)
+	    return l;
+    return NULL;
+}
+
+int
+rollup_interval(const rollup_level *l)
+{
+    return l->interval;
+}
+
+int
+rollup_finish_time(const rollup_level *l)
+{
+    return l->finish;
+}
+
+void
+rollup_report(rollup_level *l, md_array_printer *pr, FILE *fp)
+{
+    rollup_array *ra;
+    md_array_print_times(l->start, l->finish);
+    for (ra = l->arrays; ra; ra = ra->next) {
+	Current = ra;
+	md_array_print(ra->sum, pr, fp);
+    }
+    Current = NULL;
+}
+
+void
+rollup_clear_due(void)
+{
+    rollup_level *l;
+    for (l = Levels; l; l = l->next) {
+	void *saved;
+	if (!l->due)
+	    continue;
+	if (l->arena) {
+	    saved = switchArena(l->arena);
+	    freeArena();
+	    switchArena(saved);
+	}
+	l->arena = NULL;
+	l->arrays = NULL;
+	l->start = 0;
+	l->finish = 0;
+	l->due = 0;
+    }
+}
+
+static unsigned int
+label_hashfunc(const void *key)
+{
+    return hashendian(key, strlen(key), 0);
+}
+
+static int
+label_cmpfunc(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
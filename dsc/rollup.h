@@ -0,0 +1,27 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+/*
+ * Rollups sum the datasets of several report intervals into longer
+ * ones (e.g. 10 second reports rolled up into 60 and 300 second ones)
+ * without looking at the packets again.  Each rollup interval must be
+ * a multiple of the previous one; the shortest is fed from the report
+ * interval, and each longer one from the next shorter one.
+ *
+ * Rolled up arrays are keyed by label, since indexes are only valid
+ * for one report interval, and live in one arena per rollup interval.
+ */
+
+typedef struct _rollup_level rollup_level;
+
+int rollup_add_interval(int secs);
+int rollup_check(int report_interval);
+void rollup_fold(md_array *, int start, int finish);
+int rollup_finish(int finish, int flush);
+rollup_level *rollup_due(rollup_level *prev);
+int rollup_interval(const rollup_level *);
+int rollup_finish_time(const rollup_level *);
+void rollup_report(rollup_level *, md_array_printer *, FILE *);
+void rollup_clear_due(void);
+
+#endif /* ROLLUP_H */
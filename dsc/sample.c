@@ -0,0 +1,153 @@
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "dns_message.h"
+#include "md_array.h"
+#include "hashtbl.h"
+#include "sample.h"
+#include "live.h"
+
+#define SAMPLE_MAX_RATE 1024
+#define SAMPLE_CALM_INTERVALS 5	/* without drops before slowing down */
+
+static unsigned int base_rate = 1;
+static unsigned int drop_threshold = 0;	/* percent; 0 never adapts */
+static unsigned int rate = 1;		/* in effect this interval */
+static unsigned int next_rate = 1;
+static int calm = 0;
+static uint64_t kept = 0;
+static uint64_t skipped = 0;
+
+int
+sample_set_rate(int r)
+{
+    if (r < 1 || r > SAMPLE_MAX_RATE) {
+	syslog(LOG_ERR, "bad sample_rate %d (1..%d)", r, SAMPLE_MAX_RATE);
+	return 0;
+    }
+    base_rate = next_rate = r;
+    return 1;
+}
+
+int
+sample_set_drop_threshold(int pct)
+{
+    if (pct < 1 || pct > 100) {
+	syslog(LOG_ERR, "bad sample_drop_threshold %d (1..100)", pct);
+	return 0;
+    }
+    drop_threshold = pct;
+    return 1;
+}
+
+int
+sample_enabled(void)
+{
+    return base_rate > 1 || drop_threshold > 0;
+}
+
+void
+sample_begin_interval(void)
+{
+    rate = next_rate;
+    kept = 0;
+    skipped = 0;
+    md_array_count_scale(rate);
+    live_count_scale(rate);
+}
+
+/*
+ * Returns 1 if the message's flow is sampled this interval.
+ */
+int
+sample_flow(const transport_message *tm)
+{
+    struct {
+	inX_addr a1;
+	inX_addr a2;
+	unsigned short p1;
+	unsigned short p2;
+	unsigned char proto;
+    } key;
+    uint32_t pc = 0;
+    uint32_t pb = 0;
+    int c;
+
+    if (1 == rate) {
+	kept++;
+	return 1;
+    }
+    memset(&key, 0, sizeof(key));	/* padding is hashed too */
+    c = inXaddr_cmp(&tm->src_ip_addr, &tm->dst_ip_addr);
+    if (c < 0 || (0 == c && tm->src_port <= tm->dst_port)) {
+	key.a1 = tm->src_ip_addr;
+	key.p1 = tm->src_port;
+	key.a2 = tm->dst_ip_addr;
+	key.p2 = tm->dst_port;
+    } else {
+	key.a1 = tm->dst_ip_addr;
+	key.p1 = tm->dst_port;
+	key.a2 = tm->src_ip_addr;
+	key.p2 = tm->src_port;
+    }
+    key.proto = tm->proto;
+    hashlittle2(&key, sizeof(key), &pc, &pb);
+    if (pc % rate) {
+	skipped++;
+	return 0;
+    }
+    kept++;
+    return 1;
+}
+
+/*
+ * Picks the next interval's rate from this interval's kernel stats.
+ */
+void
+sample_adapt(uint64_t received, uint64_t dropped)
+{
+    if (0 == drop_threshold)
+	return;
+    if (dropped * 100 > received * drop_threshold) {
+	calm = 0;
+	if (next_rate >= SAMPLE_MAX_RATE)
+	    return;
+	next_rate = next_rate * 2 > SAMPLE_MAX_RATE ? SAMPLE_MAX_RATE : next_rate * 2;
+	syslog(LOG_NOTICE, "%llu of %llu packets dropped, sampling 1 in %u flows",
+	    (unsigned long long) dropped, (unsigned long long) received, next_rate);
+    } else if (0 == dropped && next_rate > base_rate) {
+	if (++calm < SAMPLE_CALM_INTERVALS)
+	    return;
+	calm = 0;
+	next_rate = next_rate / 2 < base_rate ? base_rate : next_rate / 2;
+	syslog(LOG_NOTICE, "no drops, sampling 1 in %u flows", next_rate);
+    }
+}
+
+/*
+ * Records the rate the interval's counts were scaled by.
+ */
+void
+sample_report(md_array_printer *pr, FILE *fp)
+{
+    char *all = "ALL";
+    if (!sample_enabled())
+	return;
+    pr->start_array(fp, "sample_stats");
+    pr->d1_type(fp, "All");
+    pr->d2_type(fp, "Statistic");
+    pr->start_data(fp);
+    pr->d1_begin(fp, all);
+    pr->print_element(fp, "sample_rate", rate);
+    pr->print_element(fp, "packets_kept", kept);
+    pr->print_element(fp, "packets_skipped", skipped);
+    pr->d1_end(fp, all);
+    pr->finish_data(fp);
+    pr->finish_array(fp);
+}
@@ -0,0 +1,26 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+/*
+ * Flow sampling.  At a rate of N, one in N flows is processed, picked
+ * by a hash of the (unordered) address and port pair, so queries and
+ * their responses, and all segments of a TCP stream, are kept or
+ * skipped together.  The same flows are picked by every collector, and
+ * the flows picked at rate 2N are a subset of those picked at rate N.
+ *
+ * Counts are scaled by the rate in effect, which only changes between
+ * intervals: when kernel drops exceed the drop threshold the rate is
+ * doubled for the next interval, and halved again (down to the
+ * configured rate) after a few intervals without drops.
+ */
+
+int sample_set_rate(int);
+int sample_set_drop_threshold(int);
+int sample_enabled(void);
+void sample_begin_interval(void);
+int sample_flow(const transport_message *);
+void sample_adapt(uint64_t received, uint64_t dropped);
+struct _md_array_printer;
+void sample_report(struct _md_array_printer *, FILE *);
+
+#endif /* SAMPLE_H */
@@ -0,0 +1,389 @@
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xmalloc.h"
+#include "dataset_opt.h"
+#include "md_array.h"
+#include "snapshot.h"
+
+/*
+ * An indexer's labels as they were when the snapshot was taken, in
+ * iteration order.
+ */
+typedef struct _frozen_labels {
+    indexer_t *indexer;
+    int n;			/* what iter_fn(NULL) returned */
+    int count;
+    int *index;
+    char **label;
+    struct _frozen_labels *next;
+} frozen_labels;
+
+enum {
+    REC_START_ARRAY,
+    REC_FINISH_ARRAY,
+    REC_D1_TYPE,
+    REC_D2_TYPE,
+    REC_START_DATA,
+    REC_FINISH_DATA,
+    REC_D1_BEGIN,
+    REC_D1_END,
+    REC_ELEMENT
+};
+
+typedef struct _recorded {
+    int op;
+    char *s;
+    uint64_t val;
+    struct _recorded *next;
+} recorded;
+
+/*
+ * Either a frozen dataset or a recorded array, in the order they
+ * are to be printed.
+ */
+typedef struct _snapshot_item {
+    md_array *array;		/* NULL for a recording */
+    frozen_labels *d1;
+    frozen_labels *d2;
+    recorded *events;
+    recorded **last;
+    struct _snapshot_item *next;
+} snapshot_item;
+
+struct _snapshot {
+    int start;
+    int finish;
+    void *arena;		/* everything, including this, lives here */
+    frozen_labels *labels;	/* one per indexer, shared by the arrays */
+    snapshot_item *items;
+    snapshot_item **last;
+    snapshot_item *recording;	/* array being recorded */
+};
+
+static snapshot *Recording = NULL;
+
+/*
+ * The frozen arrays' indexers only iterate; they walk the frozen
+ * labels of whichever item is Current.
+ */
+static snapshot_item *Current = NULL;
+static int next_d1 = 0;
+static int next_d2 = 0;
+static int snapshot_d1_iterator(char **);
+static int snapshot_d2_iterator(char **);
+static indexer_t snapshot_indexers[] = {
+    { "snapshot_d1", NULL, snapshot_d1_iterator, NULL },
+    { "snapshot_d2", NULL, snapshot_d2_iterator, NULL },
+};
+
+static int
+frozen_iterator(frozen_labels *f, int *next, char **label)
+{
+    if (NULL == label) {
+	*next = 0;
+	return f->n;
+    }
+    if (*next >= f->count)
+	return -1;
+    *label = f->label[*next];
+    return f->index[(*next)++];
+}
+
+static int
+snapshot_d1_iterator(char **label)
+{
+    return frozen_iterator(Current->d1, &next_d1, label);
+}
+
+static int
+snapshot_d2_iterator(char **label)
+{
+    return frozen_iterator(Current->d2, &next_d2, label);
+}
+
+/*
+ * Copies an indexer's labels, once per snapshot.  Must be called
+ * before the indexer is reset.
+ */
+static frozen_labels *
+frozen_labels_get(snapshot *s, indexer_t *indexer)
+{
+    frozen_labels *f;
+    char *label;
+    int alloc;
+    int i;
+    for (f = s->labels; f; f = f->next)
+	if (f->indexer == indexer)
+	    return f;
+    f = acalloc(1, sizeof(*f));
+    if (NULL == f)
+	return NULL;
+    f->indexer = indexer;
+    f->n = indexer->iter_fn(NULL);
+    /* n is usually the number of labels, but may leave out overflow */
+    alloc = f->n > 0 ? f->n + 1 : 16;
+    f->index = amalloc(alloc * sizeof(*f->index));
+    f->label = amalloc(alloc * sizeof(*f->label));
+    if (NULL == f->index || NULL == f->label)
+	return NULL;
+    while ((i = indexer->iter_fn(&label)) > -1) {
+	if (f->count == alloc) {
+	    int *index = amalloc(2 * alloc * sizeof(*index));
+	    char **labels = amalloc(2 * alloc * sizeof(*labels));
+	    if (NULL == index || NULL == labels)
+		return NULL;
+	    memcpy(index, f->index, alloc * sizeof(*index));
+	    memcpy(labels, f->label, alloc * sizeof(*labels));
+	    f->index = index;
+	    f->label = labels;
+	    alloc *= 2;
+	}
+	f->index[f->count] = i;
+	if (NULL == (f->label[f->count] = astrdup(label)))
+	    return NULL;
+	f->count++;
+    }
+    f->next = s->labels;
+    s->labels = f;
+    return f;
+}
+
+static snapshot_item *
+snapshot_item_add(snapshot *s)
+{
+    snapshot_item *it = acalloc(1, sizeof(*it));
+    if (NULL == it)
+	return NULL;
+    it->last = &it->events;
+    *s->last = it;
+    s->last = &it->next;
+    return it;
+}
+
+/*
+ * Starts a snapshot of the interval in the current arena, and
+ * records whatever is printed with snapshot_recorder into it.
+ */
+snapshot *
+snapshot_begin(int start, int finish)
+{
+    snapshot *s = acalloc(1, sizeof(*s));
+    if (NULL == s)
+	return NULL;
+    s->start = start;
+    s->finish = finish;
+    s->last = &s->items;
+    Recording = s;
+    return s;
+}
+
+void
+snapshot_add_array(snapshot *s, md_array *a)
+{
+    snapshot_item *it = snapshot_item_add(s);
+    if (NULL == it)
+	return;
+    it->d1 = frozen_labels_get(s, a->d1.indexer);
+    it->d2 = frozen_labels_get(s, a->d2.indexer);
+    it->array = amalloc(sizeof(*it->array));
+    if (NULL == it->d1 || NULL == it->d2 || NULL == it->array) {
+	syslog(LOG_CRIT, "Cant snapshot %s due to malloc failure!", a->name);
+	it->array = NULL;
+	return;
+    }
+    *it->array = *a;
+    it->array->d1.indexer = &snapshot_indexers[0];
+    it->array->d2.indexer = &snapshot_indexers[1];
+}
+
+/*
+ * Stops recording and takes the current arena over; a new one is
+ * started for the next interval.
+ */
+void
+snapshot_end(snapshot *s)
+{
+    Recording = NULL;
+    s->arena = switchArena(NULL);
+    useArena();
+}
+
+int
+snapshot_finish_time(const snapshot *s)
+{
+    return s->finish;
+}
+
+static void
+snapshot_replay(recorded *r, md_array_printer *pr, FILE *fp)
+{
+    for (; r; r = r->next) {
+	switch (r->op) {
+	case REC_START_ARRAY:
+	    pr->start_array(fp, r->s);
+	    break;
+	case REC_FINISH_ARRAY:
+	    pr->finish_array(fp);
+	    break;
+	case REC_D1_TYPE:
+	    pr->d1_type(fp, r->s);
+	    break;
+	case REC_D2_TYPE:
+	    pr->d2_type(fp, r->s);
+	    break;
+	case REC_START_DATA:
+	    pr->start_data(fp);
+	    break;
+	case REC_FINISH_DATA:
+	    pr->finish_data(fp);
+	    break;
+	case REC_D1_BEGIN:
+	    pr->d1_begin(fp, r->s);
+	    break;
+	case REC_D1_END:
+	    pr->d1_end(fp, r->s);
+	    break;
+	case REC_ELEMENT:
+	    pr->print_element(fp, r->s, r->val);
+	    break;
+	}
+    }
+}
+
+void
+snapshot_report(snapshot *s, md_array_printer *pr, FILE *fp)
+{
+    snapshot_item *it;
+    md_array_print_times(s->start, s->finish);
+    for (it = s->items; it; it = it->next) {
+	if (NULL == it->array) {
+	    snapshot_replay(it->events, pr, fp);
+	    continue;
+	}
+	Current = it;
+	md_array_print(it->array, pr, fp);
+    }
+    Current = NULL;
+}
+
+/*
+ * Prints only the arrays recorded with snapshot_recorder: the small
+ * statistics arrays.
+ */
+void
+snapshot_report_recorded(snapshot *s, md_array_printer *pr, FILE *fp)
+{
+    snapshot_item *it;
+    md_array_print_times(s->start, s->finish);
+    for (it = s->items; it; it = it->next)
+	if (NULL == it->array)
+	    snapshot_replay(it->events, pr, fp);
+}
+
+/*
+ * Frees the snapshot's arena, and so the snapshot.  Not thread safe,
+ * like the rest of the arena functions.
+ */
+void
+snapshot_free(snapshot *s)
+{
+    void *saved = switchArena(s->arena);
+    freeArena();
+    switchArena(saved);
+}
+
+/* ==== RECORDER ========================================================== */
+
+static void
+record(int op, const char *str, uint64_t val)
+{
+    snapshot_item *it;
+    recorded *r;
+    if (NULL == Recording)
+	return;
+    if (REC_START_ARRAY == op)
+	Recording->recording = snapshot_item_add(Recording);
+    if (NULL == (it = Recording->recording))
+	return;
+    r = acalloc(1, sizeof(*r));
+    if (NULL == r)
+	return;
+    r->op = op;
+    r->s = str ? astrdup(str) : NULL;
+    r->val = val;
+    *it->last = r;
+    it->last = &r->next;
+}
+
+static void
+rec_start_array(void *unused, const char *name)
+{
+    record(REC_START_ARRAY, name, 0);
+}
+
+static void
+rec_finish_array(void *unused)
+{
+    record(REC_FINISH_ARRAY, NULL, 0);
+}
+
+static void
+rec_d1_type(void *unused, const char *t)
+{
+    record(REC_D1_TYPE, t, 0);
+}
+
+static void
+rec_d2_type(void *unused, const char *t)
+{
+    record(REC_D2_TYPE, t, 0);
+}
+
+static void
+rec_start_data(void *unused)
+{
+    record(REC_START_DATA, NULL, 0);
+}
+
+static void
+rec_finish_data(void *unused)
+{
+    record(REC_FINISH_DATA, NULL, 0);
+}
+
+static void
+rec_d1_begin(void *unused, char *l)
+{
+    record(REC_D1_BEGIN, l, 0);
+}
+
+static void
+rec_d1_end(void *unused, char *l)
+{
+    record(REC_D1_END, l, 0);
+}
+
+static void
+rec_print_element(void *unused, char *l, uint64_t val)
+{
+    record(REC_ELEMENT, l, val);
+}
+
+md_array_printer snapshot_recorder = {
+    rec_start_array,
+    rec_finish_array,
+    rec_d1_type,
+    rec_d2_type,
+    rec_start_data,
+    rec_finish_data,
+    rec_d1_begin,
+    rec_d1_end,
+    rec_print_element
+};
@@ -0,0 +1,28 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*
+ * A snapshot is the frozen data of one report interval, to be written
+ * out while the next interval is being collected.  It owns the arena
+ * the interval's data was allocated in, and holds copies of the
+ * datasets' array headers and of their indexers' labels, since the
+ * indexers are reset for the next interval.  Cells are not copied.
+ *
+ * Small statistics arrays (pcap_stats and the like) are printed into
+ * the snapshot with snapshot_recorder as it is taken, and replayed in
+ * order when the snapshot is printed.
+ */
+
+typedef struct _snapshot snapshot;
+
+extern md_array_printer snapshot_recorder;
+
+snapshot *snapshot_begin(int start, int finish);
+void snapshot_add_array(snapshot *, md_array *);
+void snapshot_end(snapshot *);
+int snapshot_finish_time(const snapshot *);
+void snapshot_report(snapshot *, md_array_printer *, FILE *);
+void snapshot_report_recorded(snapshot *, md_array_printer *, FILE *);
+void snapshot_free(snapshot *);
+
+#endif /* SNAPSHOT_H */
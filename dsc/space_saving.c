@@ -0,0 +1,168 @@
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xmalloc.h"
+#include "space_saving.h"
+
+static unsigned int
+ss_hash(int key)
+{
+    unsigned int h = (unsigned int) key * 0x9E3779B1U;
+    return h ^ (h >> 16);
+}
+
+/*
+ * Returns the index table position holding 'key', or the empty
+ * position where it would go.
+ */
+static unsigned int
+ss_index_slot(const space_saving *ss, int key)
+{
+    unsigned int i = ss_hash(key) & ss->mask;
+    while (ss->index[i] && ss->counters[ss->index[i] - 1].key != key)
+	i = (i + 1) & ss->mask;
+    return i;
+}
+
+/*
+ * Linear probing deletion: shift later entries of the probe sequence
+ * back into the hole instead of leaving a tombstone.
+ */
+static void
+ss_index_remove(space_saving *ss, int key)
+{
+    unsigned int i = ss_index_slot(ss, key);
+    unsigned int j = i;
+    for (;;) {
+	unsigned int h;
+	j = (j + 1) & ss->mask;
+	if (0 == ss->index[j])
+	    break;
+	h = ss_hash(ss->counters[ss->index[j] - 1].key) & ss->mask;
+	/* leave the entry alone if its home slot is cyclically in (i,j] */
+	if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+	    continue;
+	ss->index[i] = ss->index[j];
+	i = j;
+    }
+    ss->index[i] = 0;
+}
+
+static void
+ss_heap_swap(space_saving *ss, unsigned int a, unsigned int b)
+{
+    unsigned int t = ss->heap[a];
+    ss->heap[a] = ss->heap[b];
+    ss->heap[b] = t;
+    ss->counters[ss->heap[a]].heap_pos = a;
+    ss->counters[ss->heap[b]].heap_pos = b;
+}
+
+static void
+ss_sift_up(space_saving *ss, unsigned int i)
+{
+    while (i > 0) {
+	unsigned int parent = (i - 1) / 2;
+	if (ss->counters[ss->heap[parent]].count <= ss->counters[ss->heap[i]].count)
+	    break;
+	ss_heap_swap(ss, i, parent);
+	i = parent;
+    }
+}
+
+static void
+ss_sift_down(space_saving *ss, unsigned int i)
+{
+    for (;;) {
+	unsigned int l = 2 * i + 1;
+	unsigned int r = l + 1;
+	unsigned int smallest = i;
+	if (l < ss->used && ss->counters[ss->heap[l]].count < ss->counters[ss->heap[smallest]].count)
+	    smallest = l;
+	if (r < ss->used && ss->counters[ss->heap[r]].count < ss->counters[ss->heap[smallest]].count)
+	    smallest = r;
+	if (smallest == i)
+	    break;
+	ss_heap_swap(ss, i, smallest);
+	i = smallest;
+    }
+}
+
+space_saving *
+ss_create(unsigned int k)
+{
+    space_saving *ss = acalloc(1, sizeof(*ss));
+    unsigned int index_sz = 2;
+    if (NULL == ss)
+	return NULL;
+    /* keep the index table at most half full */
+    while (index_sz < 2 * k)
+	index_sz <<= 1;
+    ss->k = k;
+    ss->mask = index_sz - 1;
+    ss->index = acalloc(index_sz, sizeof(*ss->index));
+    ss->heap = acalloc(k, sizeof(*ss->heap));
+    ss->counters = acalloc(k, sizeof(*ss->counters));
+    if (NULL == ss->index || NULL == ss->heap || NULL == ss->counters)
+	return NULL;
+    return ss;
+}
+
+void
+ss_add(space_saving *ss, int key, uint64_t n)
+{
+    unsigned int i = ss_index_slot(ss, key);
+    unsigned int c;
+
+    ss->total += n;
+    if (ss->index[i]) {
+	c = ss->index[i] - 1;
+	ss->counters[c].count += n;
+	ss_sift_down(ss, ss->counters[c].heap_pos);
+	return;
+    }
+    if (ss->used < ss->k) {
+	c = ss->used++;
+	ss->counters[c].key = key;
+	ss->counters[c].count = n;
+	ss->counters[c].err = 0;
+	ss->counters[c].heap_pos = c;
+	ss->heap[c] = c;
+	ss->index[i] = c + 1;
+	ss_sift_up(ss, c);
+	return;
+    }
+    /* hand the smallest counter over to the new key */
+    c = ss->heap[0];
+    ss_index_remove(ss, ss->counters[c].key);
+    ss->evictions++;
+    ss->counters[c].key = key;
+    ss->counters[c].err = ss->counters[c].count;
+    ss->counters[c].count += n;
+    ss->index[ss_index_slot(ss, key)] = c + 1;
+    ss_sift_down(ss, 0);
+}
+
+const ss_counter *
+ss_find(const space_saving *ss, int key)
+{
+    unsigned int i = ss_index_slot(ss, key);
+    if (0 == ss->index[i])
+	return NULL;
+    return &ss->counters[ss->index[i] - 1];
+}
+
+/*
+ * No count in the summary is too large by more than this.
+ */
+uint64_t
+ss_error_bound(const space_saving *ss)
+{
+    if (ss->used < ss->k)
+	return 0;
+    return ss->counters[ss->heap[0]].count;
+}
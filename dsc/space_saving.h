@@ -0,0 +1,42 @@
+#ifndef SPACE_SAVING_H
+#define SPACE_SAVING_H
+
+#include "config.h"
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+/*
+ * Space-Saving heavy hitter summary (Metwally, Agrawal & El Abbadi).
+ *
+ * Keeps at most 'k' counters.  When a new key arrives and all counters
+ * are taken, the smallest counter is handed over to the new key, which
+ * inherits its count.  That inherited amount is remembered as 'err',
+ * so every count is an overestimate by at most 'err', and never by
+ * more than ss_error_bound().  The summary lives in the arena.
+ */
+
+typedef struct {
+    int key;
+    uint64_t count;		/* estimated count, never too small */
+    uint64_t err;		/* maximum overestimation of 'count' */
+    unsigned int heap_pos;
+} ss_counter;
+
+typedef struct _space_saving {
+    unsigned int k;		/* number of counters */
+    unsigned int used;
+    unsigned int mask;		/* index table size - 1 */
+    unsigned int *index;	/* key -> counter number + 1, 0 if empty */
+    unsigned int *heap;		/* counter numbers, min-heap on count */
+    ss_counter *counters;
+    uint64_t total;		/* sum of everything added */
+    uint64_t evictions;		/* number of counters handed over */
+} space_saving;
+
+space_saving *ss_create(unsigned int k);
+void ss_add(space_saving *, int key, uint64_t n);
+const ss_counter *ss_find(const space_saving *, int key);
+uint64_t ss_error_bound(const space_saving *);
+
+#endif /* SPACE_SAVING_H */
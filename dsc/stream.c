@@ -0,0 +1,451 @@
+#define _GNU_SOURCE		/* for memfd_create() */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <syslog.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#include "xmalloc.h"
+#include "stream.h"
+
+#define SPOOL_DIR "spool"
+
+typedef struct _frame frame;
+struct _frame {
+    frame *next;
+    char *name;
+    char *data;			/* header, then the file */
+    size_t hlen;
+    size_t len;
+    int spooled;		/* read back from the spool */
+};
+
+static char *sock_path = NULL;
+static size_t buffer_max = 0;
+static int sock = -1;
+static int acks = 0;		/* the consumer acknowledges frames */
+static int down = 0;		/* logged that the consumer is gone */
+
+static frame *head = NULL;
+static frame *tail = NULL;
+static frame *unsent = NULL;	/* first frame not sent in full */
+static size_t queued = 0;	/* bytes in the queue */
+static size_t sent = 0;		/* bytes of 'unsent' sent */
+
+int
+stream_set_path(const char *path, int buffer_mb)
+{
+    struct sockaddr_un sun;
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+	syslog(LOG_ERR, "output_socket: %s: path too long", path);
+	return 0;
+    }
+    if (buffer_mb < 1) {
+	syslog(LOG_ERR, "output_socket: buffer must be at least 1 MB");
+	return 0;
+    }
+    if (NULL == (sock_path = xstrdup(path)))
+	return 0;
+    buffer_max = (size_t) buffer_mb << 20;
+    signal(SIGPIPE, SIG_IGN);
+    return 1;
+}
+
+int
+stream_enabled(void)
+{
+    return NULL != sock_path;
+}
+
+/*
+ * Returns a descriptor for a report to be written to, in memory
+ * where the system allows.
+ */
+int
+stream_tmpfile(void)
+{
+#if HAVE_MEMFD_CREATE
+    return memfd_create("dscreport", MFD_CLOEXEC);
+#else
+    char tname[] = ".dscreport.XXXXXXXXX";
+    int fd = mkstemp(tname);
+    if (fd >= 0)
+	unlink(tname);
+    return fd;
+#endif
+}
+
+static int
+write_all(int fd, const char *buf, size_t n)
+{
+    while (n) {
+	ssize_t x = write(fd, buf, n);
+	if (x < 0 && EINTR == errno)
+	    continue;
+	if (x < 0)
+	    return -1;
+	buf += x;
+	n -= x;
+    }
+    return 0;
+}
+
+/* ==== QUEUE ============================================================= */
+
+static void
+frame_free(frame *f)
+{
+    xfree(f->name);
+    xfree(f->data);
+    xfree(f);
+}
+
+static frame *
+frame_new(const char *name, size_t size)
+{
+    frame *f = xcalloc(1, sizeof(*f));
+    if (NULL == f)
+	return NULL;
+    f->hlen = snprintf(NULL, 0, "%s %lu\n", name, (unsigned long) size);
+    f->len = f->hlen + size;
+    f->name = xstrdup(name);
+    f->data = xmalloc(f->len + 1);	/* room for snprintf()'s NUL */
+    if (NULL == f->name || NULL == f->data) {
+	frame_free(f);
+	return NULL;
+    }
+    snprintf(f->data, f->hlen + 1, "%s %lu\n", name, (unsigned long) size);
+    return f;
+}
+
+static void
+frame_pop(void)
+{
+    frame *f = head;
+    if (NULL == (head = f->next))
+	tail = NULL;
+    if (f == unsent) {
+	unsent = f->next;
+	sent = 0;
+    }
+    queued -= f->len;
+    frame_free(f);
+}
+
+/*
+ * Queues the report written to fd, and closes fd.  Returns 0 on
+ * success, like dump_report().
+ */
+int
+stream_add(const char *name, int fd)
+{
+    off_t size = lseek(fd, 0, SEEK_END);
+    off_t off;
+    ssize_t x;
+    frame *f;
+    if (size < 0 || NULL == (f = frame_new(name, size))) {
+	syslog(LOG_ERR, "%s: %s", name, strerror(errno));
+	close(fd);
+	return 1;
+    }
+    for (off = 0; off < size; off += x) {
+	x = pread(fd, f->data + f->hlen + off, size - off, off);
+	if (x < 0 && EINTR == errno) {
+	    x = 0;
+	    continue;
+	}
+	if (x <= 0) {
+	    syslog(LOG_ERR, "%s: %s", name, x < 0 ? strerror(errno) : "short read");
+	    frame_free(f);
+	    close(fd);
+	    return 1;
+	}
+    }
+    close(fd);
+    if (tail)
+	tail->next = f;
+    else
+	head = f;
+    tail = f;
+    if (NULL == unsent)
+	unsent = f;
+    queued += f->len;
+    return 0;
+}
+
+/* ==== SPOOL ============================================================= */
+
+/*
+ * Makes the spool path of a file, or of its temporary version when
+ * 'prefix' is ".".  Returns -1 if it does not fit.
+ */
+static int
+spool_path(char *buf, size_t len, const char *prefix, const char *name)
+{
+    int n = snprintf(buf, len, "%s/%s%s", SPOOL_DIR, prefix, name);
+    if (n < 0 || (size_t) n >= len) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    return 0;
+}
+
+static void
+spool_frame(frame *f)
+{
+    char fname[PATH_MAX];
+    char tname[PATH_MAX];
+    int fd;
+    if (f->spooled)
+	return;			/* still there */
+    if (spool_path(fname, sizeof(fname), "", f->name) < 0
+	|| spool_path(tname, sizeof(tname), ".", f->name) < 0
+	|| (mkdir(SPOOL_DIR, 0775) < 0 && EEXIST != errno)) {
+	syslog(LOG_ERR, "%s: %s; %s lost", SPOOL_DIR, strerror(errno), f->name);
+	return;
+    }
+    fd = open(tname, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0
+	|| write_all(fd, f->data + f->hlen, f->len - f->hlen) < 0
+	|| close(fd) < 0) {
+	syslog(LOG_ERR, "%s: %s; %s lost", tname, strerror(errno), f->name);
+	if (fd >= 0)
+	    close(fd);
+	unlink(tname);
+	return;
+    }
+    rename(tname, fname);
+}
+
+static void
+spool_all(void)
+{
+    while (head) {
+	spool_frame(head);
+	frame_pop();
+    }
+}
+
+/*
+ * Spools the newest frames, for the queue to fit in the buffer.  What
+ * is sent, even in part, stays until it is acknowledged.
+ */
+static void
+spool_over(void)
+{
+    frame *keep = head;
+    frame *f;
+    size_t n;
+    if (NULL == head)
+	return;
+    n = head->len;
+    while (keep != unsent && keep->next) {
+	keep = keep->next;
+	n += keep->len;
+    }
+    while (keep->next && n + keep->next->len <= buffer_max) {
+	keep = keep->next;
+	n += keep->len;
+    }
+    while ((f = keep->next)) {
+	keep->next = f->next;
+	spool_frame(f);
+	queued -= f->len;
+	frame_free(f);
+    }
+    tail = keep;
+}
+
+static int
+spool_filter(const struct dirent *d)
+{
+    return '.' != d->d_name[0];
+}
+
+/*
+ * Queues spooled files, oldest (by name) first, as many as fit in the
+ * buffer.  Only called with the queue empty, so none is queued twice.
+ */
+static int
+spool_load(void)
+{
+    struct dirent **names;
+    char fname[PATH_MAX];
+    int n = scandir(SPOOL_DIR, &names, spool_filter, alphasort);
+    int i;
+    int fd;
+    if (n < 0)
+	return 0;
+    for (i = 0; i < n; i++) {
+	if (queued < buffer_max) {
+	    if (spool_path(fname, sizeof(fname), "", names[i]->d_name) < 0
+		|| (fd = open(fname, O_RDONLY)) < 0)
+		syslog(LOG_ERR, "%s: %s", fname, strerror(errno));
+	    else if (0 == stream_add(names[i]->d_name, fd))
+		tail->spooled = 1;
+	}
+	free(names[i]);
+    }
+    free(names);
+    return NULL != head;
+}
+
+/* ==== SENDING =========================================================== */
+
+static int
+stream_connect(void)
+{
+    struct sockaddr_un sun;
+    struct stat sb;
+    int fd;
+    acks = 0;
+    if (0 == stat(sock_path, &sb) && S_ISFIFO(sb.st_mode))
+	return open(sock_path, O_WRONLY | O_NONBLOCK);	/* ENXIO if no reader */
+    acks = 1;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, sock_path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	return -1;
+    if (connect(fd, (struct sockaddr *) &sun, sizeof(sun)) < 0
+	|| fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+	int e = errno;
+	close(fd);
+	errno = e;
+	return -1;
+    }
+    return fd;
+}
+
+static void
+stream_down(void)
+{
+    if (!down)
+	syslog(LOG_NOTICE, "output_socket %s: %s; spooling to %s",
+	    sock_path, strerror(errno), SPOOL_DIR);
+    down = 1;
+    if (sock >= 0)
+	close(sock);
+    sock = -1;
+}
+
+/*
+ * A frame is taken once the consumer acknowledged it, or (for a FIFO)
+ * once it is sent.
+ */
+static void
+frame_taken(void)
+{
+    char fname[PATH_MAX];
+    if (head->spooled && 0 == spool_path(fname, sizeof(fname), "", head->name))
+	unlink(fname);
+    frame_pop();
+}
+
+/*
+ * Sends as much as the consumer takes without waiting.
+ */
+static int
+stream_send(void)
+{
+    while (unsent) {
+	ssize_t x = write(sock, unsent->data + sent, unsent->len - sent);
+	if (x < 0) {
+	    if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+		return 0;
+	    stream_down();
+	    return -1;
+	}
+	if ((sent += x) < unsent->len)
+	    continue;
+	unsent = unsent->next;
+	sent = 0;
+	if (!acks)
+	    frame_taken();
+    }
+    return 0;
+}
+
+/*
+ * Reads acknowledgements, one line per frame.
+ */
+static int
+stream_acks(void)
+{
+    char buf[512];
+    ssize_t x;
+    ssize_t i;
+    while ((x = read(sock, buf, sizeof(buf))) > 0)
+	for (i = 0; i < x; i++)
+	    if ('\n' == buf[i] && head && head != unsent)
+		frame_taken();
+    if (x < 0 && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno))
+	return 0;
+    if (0 == x)
+	errno = ECONNRESET;
+    stream_down();
+    return -1;
+}
+
+/*
+ * Sends queued frames, then spooled ones, until they are all taken
+ * or the deadline has passed.  Called by the writer thread after each
+ * interval's reports are queued.
+ */
+void
+stream_flush(time_t deadline)
+{
+    struct pollfd p;
+    time_t now;
+    if (sock < 0) {
+	if ((sock = stream_connect()) < 0) {
+	    stream_down();
+	    spool_all();
+	    return;
+	}
+	if (down)
+	    syslog(LOG_NOTICE, "output_socket %s: connected", sock_path);
+	down = 0;
+    }
+    while ((head || spool_load()) && (now = time(NULL)) < deadline) {
+	p.fd = sock;
+	p.events = (unsent ? POLLOUT : 0) | (acks ? POLLIN : 0);
+	p.revents = 0;
+	if (poll(&p, 1, (deadline - now) * 1000) <= 0)
+	    continue;
+	if (acks && (p.revents & (POLLIN | POLLHUP | POLLERR)) && stream_acks() < 0)
+	    break;
+	if (unsent && (p.revents & (POLLOUT | POLLHUP | POLLERR)) && stream_send() < 0)
+	    break;
+    }
+    if (sock < 0)
+	spool_all();
+    else
+	spool_over();
+}
+
+/*
+ * Sends what can be sent before dsc exits, and spools the rest.
+ */
+void
+stream_finish(time_t deadline)
+{
+    stream_flush(deadline);
+    spool_all();
+    if (sock >= 0)
+	close(sock);
+    sock = -1;
+}
@@ -0,0 +1,33 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/*
+ * Streaming output (output_socket).  Instead of being written to files
+ * in run_dir, each report is written into memory and sent to a local
+ * consumer over a UNIX stream socket or a FIFO, as a frame:
+ *
+ *	<file name> <length>\n
+ *	<length bytes: the file as it would have been written>
+ *
+ * On a socket, the consumer acknowledges each frame once it has dealt
+ * with it, with a line (the file name, say).  Until then the frame is
+ * kept, and sent again if the connection is lost.  A FIFO has no way
+ * back, so a frame counts as taken once it is written to it.
+ *
+ * Frames not yet sent are queued in memory, up to a limit.  When the
+ * consumer is slow, sending waits for it, but for no more than half
+ * a report interval; what does not fit in the queue after that is
+ * spooled to files in run_dir/spool.  When the consumer is down (or
+ * goes away), everything is spooled; once it is back, the spooled
+ * files are sent, oldest first, after whatever is queued.  A frame cut
+ * short by EOF should be dropped: it is sent again in full.
+ */
+
+int stream_set_path(const char *path, int buffer_mb);
+int stream_enabled(void);
+int stream_tmpfile(void);
+int stream_add(const char *name, int fd);
+void stream_flush(time_t deadline);
+void stream_finish(time_t deadline);
+
+#endif /* STREAM_H */
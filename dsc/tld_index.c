@@ -7,16 +7,19 @@
 #include "dns_message.h"
 #include "md_array.h"
 #include "hashtbl.h"
+#include "hll.h"
+#include "index_limit.h"
+#include "qname_pool.h"
 
-static hashfunc tld_hashfunc;
 static hashkeycmp tld_cmpfunc;
 
 #define MAX_ARRAY_SZ 65536
 static hashtbl *theHash = NULL;
 static int next_idx = 0;
+static index_limit limit;
 
 typedef struct {
-	char *tld;
+	const char *tld;	/* in the qname pool */
 	int index;
 } tldobj;
 
@@ -24,33 +27,35 @@ int
 tld_indexer(const void *vp)
 {
     const dns_message *m = vp;
-    const char *tld;
+    const qname_suffixes *s;
     tldobj *obj;
     if (m->malformed)
 	return -1;
-    tld = dns_message_tld((dns_message *) m);
+    s = qname_pool_suffixes(m);
     if (NULL == theHash) {
-	theHash = hash_create(MAX_ARRAY_SZ, tld_hashfunc, tld_cmpfunc,
-	    1, afree, afree);
+	theHash = hash_create(MAX_ARRAY_SZ, qname_pool_hash, tld_cmpfunc,
+	    1, NULL, afree);
 	if (NULL == theHash)
 	    return -1;
     }
-    if ((obj = hash_find(tld, theHash)))
+    if ((obj = hash_find_hashed(s->name[1], s->hash[1], theHash)))
 	return obj->index;
+    if (index_limit_reached(&limit, next_idx))
+	return limit.max_keys;
     obj = acalloc(1, sizeof(*obj));
     if (NULL == obj)
 	return -1;
-    obj->tld = astrdup(tld);
+    obj->tld = qname_pool_intern(m, s->name[1]);
     if (NULL == obj->tld) {
 	afree(obj);
 	return -1;
     }
     obj->index = next_idx;
-    if (0 != hash_add(obj->tld, obj, theHash)) {
-	afree(obj->tld);
+    if (0 != hash_add_hashed(obj->tld, s->hash[1], obj, theHash)) {
 	afree(obj);
 	return -1;
     }
+    limit.bytes += sizeof(*obj) + HASH_ITEM_BYTES;
     next_idx++;
     return obj->index;
 }
@@ -65,10 +70,11 @@ tld_iterator(char **label)
     if (NULL == label) {
 	/* initialize and tell caller how big the array is */
 	hash_iter_init(theHash);
-	return next_idx;
+	index_limit_iter_init(&limit);
+	return next_idx + 1;
     }
     if ((obj = hash_iterate(theHash)) == NULL)
-	return -1;
+	return index_limit_iterate(&limit, label);
     snprintf(label_buf, MAX_QNAME_SZ, "%s", obj->tld);
     *label = label_buf;
     return obj->index;
@@ -79,12 +85,32 @@ tld_reset()
 {
     theHash = NULL;
     next_idx = 0;
+    qname_pool_reset();
+    index_limit_reset(&limit);
 }
 
-static unsigned int
-tld_hashfunc(const void *key)
+void
+tld_max_keys(int max_keys)
 {
-	return hashendian(key, strlen(key), 0);
+    index_limit_set(&limit, max_keys);
+}
+
+int
+tld_stats(char **label, uint64_t *val)
+{
+    return index_limit_stats(&limit, next_idx, label, val);
+}
+
+int
+tld_hasher(const void *vp, uint64_t *hash)
+{
+    const dns_message *m = vp;
+    const char *tld;
+    if (m->malformed)
+	return -1;
+    tld = dns_message_tld((dns_message *) m);
+    *hash = hll_hash(tld, strlen(tld));
+    return 0;
 }
 
 static int
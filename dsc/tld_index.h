@@ -1,3 +1,6 @@
 int tld_indexer(const void *);
 int tld_iterator(char **label);
 void tld_reset(void);
+void tld_max_keys(int);
+int tld_stats(char **label, uint64_t *val);
+int tld_hasher(const void *, uint64_t *);
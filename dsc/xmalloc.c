@@ -12,6 +12,7 @@
 #if HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
+#include <sys/mman.h>
 #include "xmalloc.h"
 #include "syslog_debug.h"
 
@@ -66,31 +67,101 @@ typedef struct arena {
     struct arena *prevArena;
     u_char *end;
     u_char *nextAlloc;
+    size_t mapped;		/* length of the chunk's mapping */
 } Arena;
 
 Arena *currentArena = NULL;
 
 #define align(size, a) (((size_t)(size) + ((a) - 1)) & ~((a)-1))
-#define ALIGNMENT 4
+#define ALIGNMENT 16
 #define HEADERSIZE align(sizeof(Arena), ALIGNMENT)
 #define CHUNK_SIZE (1 * 1024 * 1024 + 1024)
+#define HUGE_CHUNK_SIZE (2 * 1024 * 1024)
+#define POOL_MAX 256
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * Chunks are mmap'ed.  Freed chunks of the standard size are kept in
+ * a pool for the next interval instead of being unmapped; their pages
+ * are given back with MADV_DONTNEED, so that the pool does not hold on
+ * to the memory.
+ */
+static Arena *pool[POOL_MAX];
+static int pooled = 0;
+static int huge_pages = 0;
+
+static size_t
+chunk_bytes(void)
+{
+    if (huge_pages)
+	return HUGE_CHUNK_SIZE;
+    return align(HEADERSIZE + CHUNK_SIZE, getpagesize());
+}
+
+static void *
+mapChunk(size_t len)
+{
+    u_char *p;
+    size_t slop = 0;
+    if (huge_pages && HUGE_CHUNK_SIZE == len)
+	slop = len;		/* transparent huge pages need alignment */
+    p = mmap(NULL, len + slop, PROT_READ | PROT_WRITE,
+	MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == (void *) p) {
+	syslog(LOG_CRIT, "amalloc %d: %s", (int) len, strerror(errno));
+	return NULL;
+    }
+    if (slop) {
+	u_char *q = (u_char *) align(p, HUGE_CHUNK_SIZE);
+	if (q > p)
+	    munmap(p, q - p);
+	if (q + len < p + len + slop)
+	    munmap(q + len, p + slop - q);
+	p = q;
+#ifdef MADV_HUGEPAGE
+	madvise(p, len, MADV_HUGEPAGE);
+#endif
+    }
+    return p;
+}
 
 static Arena *
 newArena(size_t size)
 {
     Arena *arena;
-    size = align(size, ALIGNMENT);
-    arena = malloc(HEADERSIZE + size);
-    if (NULL == arena) {
-	syslog(LOG_CRIT, "amalloc %d: %s", (int) size, strerror(errno));
-	return NULL;
+    size_t len = HEADERSIZE + align(size, ALIGNMENT);
+    if (len <= chunk_bytes()) {
+	len = chunk_bytes();
+	arena = pooled ? pool[--pooled] : mapChunk(len);
+    } else {
+	len = align(len, getpagesize());
+	arena = mapChunk(len);
     }
+    if (NULL == arena)
+	return NULL;
     arena->prevArena = NULL;
     arena->nextAlloc = (u_char*)arena + HEADERSIZE;
-    arena->end = arena->nextAlloc + size;
+    arena->end = (u_char*)arena + len;
+    arena->mapped = len;
     return arena;
 }
 
+static void
+retireArena(Arena *arena)
+{
+    if (arena->mapped != chunk_bytes() || pooled == POOL_MAX) {
+	munmap(arena, arena->mapped);
+	return;
+    }
+#ifdef MADV_DONTNEED
+    madvise(arena, arena->mapped, MADV_DONTNEED);
+#endif
+    pool[pooled++] = arena;
+}
+
 void
 useArena()
 {
@@ -102,11 +173,46 @@ freeArena()
 {
     while (currentArena) {
 	Arena *prev = currentArena->prevArena;
-	free(currentArena);
+	retireArena(currentArena);
 	currentArena = prev;
     }
 }
 
+void *
+switchArena(void *arena)
+{
+    Arena *prev = currentArena;
+    currentArena = arena;
+    return prev;
+}
+
+/*
+ * Back chunks with (transparent) huge pages.  Call before the first
+ * useArena().
+ */
+void
+arenaHugePages(int on)
+{
+    huge_pages = on;
+}
+
+/*
+ * Size of the current arena.  Arenas only grow until freeArena(), so
+ * this is also their high-water mark.
+ */
+void
+arenaStats(arena_stats *st)
+{
+    Arena *a;
+    memset(st, 0, sizeof(*st));
+    for (a = currentArena; a; a = a->prevArena) {
+	st->used += a->nextAlloc - ((u_char*)a + HEADERSIZE);
+	st->reserved += a->mapped;
+	st->chunks++;
+    }
+    st->pooled = pooled;
+}
+
 void *
 amalloc(size_t size)
 {
@@ -118,9 +224,12 @@ amalloc(size_t size)
 	     * continue to use the current chunk for future smaller
 	     * allocations. */
 	    Arena *new = newArena(size);
+	    if (NULL == new)
+		return NULL;
 	    new->prevArena = currentArena->prevArena;
 	    currentArena->prevArena = new;
-	    return new->nextAlloc;
+	    new->nextAlloc += size;
+	    return (u_char*)new + HEADERSIZE;
 	}
 	/* Move on to a new chunk. */
 	Arena *new = newArena(CHUNK_SIZE);
@@ -16,9 +16,23 @@ void xfree(void *ptr);
  * freeArena(), which quickly frees _everything_ allocated by these functions.
  * afree() is actually a no-op, and arealloc() does not free the original;
  * these will waste space if used heavily.
+ * switchArena() makes another arena current and returns the previous one,
+ * so data that must outlive the current arena can be kept in its own
+ * (pass NULL and call useArena() to start a new one).
+ * Freed chunks are kept for reuse rather than given back to malloc.
  */
+typedef struct {
+    size_t used;		/* bytes handed out */
+    size_t reserved;		/* bytes mapped for them */
+    int chunks;
+    int pooled;			/* free chunks kept for reuse */
+} arena_stats;
+
 void useArena();
 void freeArena();
+void * switchArena(void *arena);
+void arenaHugePages(int on);
+void arenaStats(arena_stats *);
 void * amalloc(size_t size);
 void * acalloc(size_t number, size_t size);
 void * arealloc(void *ptr, size_t size);
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "dscbin.h"
+
+#define DSCBIN_HEAD_SZ 5	/* magic and version */
+
+/* ==== READER ============================================================ */
+
+struct _dscbin_reader {
+    FILE *fp;
+    unsigned char *body;	/* the current array */
+    size_t len;
+    size_t alloc;
+    size_t pos;
+    char *pool;			/* its strings, NUL terminated */
+    size_t pool_len;
+    char **dict;		/* its distinct labels */
+    size_t ndict;
+    int in_row;			/* a row's cells are not all read */
+};
+
+static int
+read_varint(FILE *fp, uint64_t *v)
+{
+    int shift = 0;
+    int c;
+    *v = 0;
+    while ((c = getc(fp)) != EOF) {
+	if (shift > 63)
+	    return -1;
+	*v |= (uint64_t) (c & 0x7f) << shift;
+	if (0 == (c & 0x80))
+	    return 1;
+	shift += 7;
+    }
+    return shift ? -1 : 0;
+}
+
+static int
+body_varint(dscbin_reader *r, uint64_t *v)
+{
+    int shift = 0;
+    *v = 0;
+    while (r->pos < r->len) {
+	unsigned char c = r->body[r->pos++];
+	if (shift > 63)
+	    return -1;
+	*v |= (uint64_t) (c & 0x7f) << shift;
+	if (0 == (c & 0x80))
+	    return 0;
+	shift += 7;
+    }
+    return -1;
+}
+
+/*
+ * Copies n bytes of the body into the pool.  The pool is as large as
+ * the body plus one NUL per byte, so pointers into it stay valid.
+ */
+static char *
+body_bytes(dscbin_reader *r, uint64_t n)
+{
+    char *s;
+    if (n > r->len - r->pos)
+	return NULL;
+    s = r->pool + r->pool_len;
+    memcpy(s, r->body + r->pos, n);
+    s[n] = '\0';
+    r->pos += n;
+    r->pool_len += n + 1;
+    return s;
+}
+
+static const char *
+body_string(dscbin_reader *r)
+{
+    uint64_t n;
+    if (body_varint(r, &n) < 0)
+	return NULL;
+    return body_bytes(r, n);
+}
+
+/*
+ * Returns 1 with a label, 0 at the end of a row, -1 on errors.
+ */
+static int
+body_label(dscbin_reader *r, const char **label)
+{
+    uint64_t code;
+    char *s;
+    if (body_varint(r, &code) < 0)
+	return -1;
+    if (0 == code)
+	return 0;
+    if (0 == (code & 1)) {
+	if (code / 2 - 1 >= r->ndict)
+	    return -1;
+	*label = r->dict[code / 2 - 1];
+	return 1;
+    }
+    if (NULL == (s = body_bytes(r, code / 2)))
+	return -1;
+    r->dict[r->ndict++] = s;
+    *label = s;
+    return 1;
+}
+
+dscbin_reader *
+dscbin_open(FILE *fp)
+{
+    char head[DSCBIN_HEAD_SZ];
+    dscbin_reader *r;
+    if (fread(head, 1, sizeof(head), fp) != sizeof(head))
+	return NULL;
+    if (memcmp(head, DSCBIN_MAGIC, 4) || DSCBIN_VERSION != head[4])
+	return NULL;
+    r = calloc(1, sizeof(*r));
+    if (NULL == r)
+	return NULL;
+    r->fp = fp;
+    return r;
+}
+
+int
+dscbin_next_array(dscbin_reader *r, dscbin_array *a)
+{
+    uint64_t len;
+    uint64_t v;
+    int x = read_varint(r->fp, &len);
+    if (x <= 0)
+	return x;
+    if (len > r->alloc) {
+	unsigned char *body = realloc(r->body, len);
+	char *pool = realloc(r->pool, 2 * len);
+	char **dict = realloc(r->dict, len * sizeof(*dict));
+	if (body)
+	    r->body = body;
+	if (pool)
+	    r->pool = pool;
+	if (dict)
+	    r->dict = dict;
+	if (NULL == body || NULL == pool || NULL == dict)
+	    return -1;
+	r->alloc = len;
+    }
+    if (fread(r->body, 1, len, r->fp) != len)
+	return -1;
+    r->len = len;
+    r->pos = 0;
+    r->pool_len = 0;
+    r->ndict = 0;
+    r->in_row = 0;
+    if (NULL == (a->name = body_string(r)))
+	return -1;
+    if (body_varint(r, &v) < 0)
+	return -1;
+    a->start_time = v;
+    if (body_varint(r, &v) < 0)
+	return -1;
+    a->stop_time = v;
+    if (NULL == (a->d1_type = body_string(r)))
+	return -1;
+    if (NULL == (a->d2_type = body_string(r)))
+	return -1;
+    return 1;
+}
+
+int
+dscbin_next_row(dscbin_reader *r, const char **label)
+{
+    int x;
+    if (r->in_row) {
+	const char *l;
+	uint64_t count;
+	while ((x = dscbin_next_cell(r, &l, &count)) > 0);
+	if (x < 0)
+	    return x;
+    }
+    if (r->pos == r->len)
+	return 0;
+    if ((x = body_label(r, label)) <= 0)
+	return -1;		/* a row cannot start with its end */
+    r->in_row = 1;
+    return 1;
+}
+
+int
+dscbin_next_cell(dscbin_reader *r, const char **label, uint64_t *count)
+{
+    int x;
+    if (!r->in_row)
+	return 0;
+    if ((x = body_label(r, label)) <= 0) {
+	r->in_row = 0;
+	return x;
+    }
+    if (body_varint(r, count) < 0)
+	return -1;
+    return 1;
+}
+
+void
+dscbin_close(dscbin_reader *r)
+{
+    free(r->body);
+    free(r->pool);
+    free(r->dict);
+    free(r);
+}
+
+/* ==== WRITER ============================================================ */
+
+/*
+ * The dictionary is a small open addressed table of indexes into the
+ * labels array.
+ */
+struct _dscbin_writer {
+    FILE *fp;
+    unsigned char *body;
+    size_t len;
+    size_t alloc;
+    char **labels;
+    size_t nlabels;
+    size_t labels_alloc;
+    unsigned int *slots;	/* label index + 1, 0 if free */
+    size_t nslots;		/* a power of two */
+};
+
+static unsigned int
+label_hash(const char *s)
+{
+    unsigned int h = 2166136261U;
+    while (*s)
+	h = (h ^ (unsigned char) *s++) * 16777619U;
+    return h;
+}
+
+static int
+put_bytes(dscbin_writer *w, const void *p, size_t n)
+{
+    if (w->len + n > w->alloc) {
+	size_t alloc = w->alloc ? w->alloc : 65536;
+	unsigned char *body;
+	while (alloc < w->len + n)
+	    alloc *= 2;
+	if (NULL == (body = realloc(w->body, alloc)))
+	    return -1;
+	w->body = body;
+	w->alloc = alloc;
+    }
+    memcpy(w->body + w->len, p, n);
+    w->len += n;
+    return 0;
+}
+
+static int
+varint_encode(unsigned char *p, uint64_t v)
+{
+    int n = 0;
+    while (v >= 0x80) {
+	p[n++] = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+static int
+put_varint(dscbin_writer *w, uint64_t v)
+{
+    unsigned char tmp[10];
+    return put_bytes(w, tmp, varint_encode(tmp, v));
+}
+
+static int
+put_string(dscbin_writer *w, const char *s)
+{
+    size_t n = strlen(s);
+    if (put_varint(w, n) < 0)
+	return -1;
+    return put_bytes(w, s, n);
+}
+
+static void
+dict_clear(dscbin_writer *w)
+{
+    size_t i;
+    for (i = 0; i < w->nlabels; i++)
+	free(w->labels[i]);
+    w->nlabels = 0;
+    if (w->slots)
+	memset(w->slots, 0, w->nslots * sizeof(*w->slots));
+}
+
+static int
+dict_grow(dscbin_writer *w)
+{
+    size_t nslots = w->nslots ? 2 * w->nslots : 1024;
+    unsigned int *slots = calloc(nslots, sizeof(*slots));
+    size_t i;
+    if (NULL == slots)
+	return -1;
+    for (i = 0; i < w->nlabels; i++) {
+	size_t s = label_hash(w->labels[i]) & (nslots - 1);
+	while (slots[s])
+	    s = (s + 1) & (nslots - 1);
+	slots[s] = i + 1;
+    }
+    free(w->slots);
+    w->slots = slots;
+    w->nslots = nslots;
+    return 0;
+}
+
+static int
+put_label(dscbin_writer *w, const char *l)
+{
+    size_t s;
+    size_t n = strlen(l);
+    if (2 * (w->nlabels + 1) > w->nslots && dict_grow(w) < 0)
+	return -1;
+    s = label_hash(l) & (w->nslots - 1);
+    while (w->slots[s]) {
+	if (0 == strcmp(w->labels[w->slots[s] - 1], l))
+	    return put_varint(w, 2 * (uint64_t) w->slots[s]);
+	s = (s + 1) & (w->nslots - 1);
+    }
+    if (w->nlabels == w->labels_alloc) {
+	size_t alloc = w->labels_alloc ? 2 * w->labels_alloc : 1024;
+	char **labels = realloc(w->labels, alloc * sizeof(*labels));
+	if (NULL == labels)
+	    return -1;
+	w->labels = labels;
+	w->labels_alloc = alloc;
+    }
+    if (NULL == (w->labels[w->nlabels] = strdup(l)))
+	return -1;
+    w->slots[s] = ++w->nlabels;
+    if (put_varint(w, 2 * (uint64_t) n + 1) < 0)
+	return -1;
+    return put_bytes(w, l, n);
+}
+
+dscbin_writer *
+dscbin_create(FILE *fp)
+{
+    dscbin_writer *w = calloc(1, sizeof(*w));
+    if (NULL == w)
+	return NULL;
+    w->fp = fp;
+    if (fwrite(DSCBIN_MAGIC "\001", 1, DSCBIN_HEAD_SZ, fp) != DSCBIN_HEAD_SZ) {
+	free(w);
+	return NULL;
+    }
+    return w;
+}
+
+int
+dscbin_start_array(dscbin_writer *w, const dscbin_array *a)
+{
+    w->len = 0;
+    dict_clear(w);
+    if (put_string(w, a->name) < 0)
+	return -1;
+    if (put_varint(w, a->start_time) < 0 || put_varint(w, a->stop_time) < 0)
+	return -1;
+    if (put_string(w, a->d1_type) < 0)
+	return -1;
+    return put_string(w, a->d2_type);
+}
+
+int
+dscbin_start_row(dscbin_writer *w, const char *label)
+{
+    return put_label(w, label);
+}
+
+int
+dscbin_cell(dscbin_writer *w, const char *label, uint64_t count)
+{
+    if (put_label(w, label) < 0)
+	return -1;
+    return put_varint(w, count);
+}
+
+int
+dscbin_end_row(dscbin_writer *w)
+{
+    return put_varint(w, 0);
+}
+
+int
+dscbin_finish_array(dscbin_writer *w)
+{
+    unsigned char tmp[10];
+    int n = varint_encode(tmp, w->len);
+    if (fwrite(tmp, 1, n, w->fp) != n)
+	return -1;
+    if (fwrite(w->body, 1, w->len, w->fp) != w->len)
+	return -1;
+    return 0;
+}
+
+void
+dscbin_free(dscbin_writer *w)
+{
+    dict_clear(w);
+    free(w->labels);
+    free(w->slots);
+    free(w->body);
+    free(w);
+}
@@ -0,0 +1,67 @@
+#ifndef DSCBIN_H
+#define DSCBIN_H
+
+/*
+ * Reads and writes dsc's binary data files (output_format binary).
+ *
+ * A file holds a sequence of 2-dimensional arrays, like the XML data
+ * files: each array has a name, start and stop times, two dimension
+ * types, and rows of cells.  Each row has a (dimension 1) label, and
+ * each cell a (dimension 2) label and a count.  Labels are returned
+ * as they are, never base64 encoded.
+ *
+ * The format (version 1) is described in dsc/md_array_binary_printer.c.
+ *
+ * Reading goes array by array, row by row, and cell by cell:
+ *
+ *	dscbin_reader *r = dscbin_open(fp);
+ *	while (dscbin_next_array(r, &a) > 0)
+ *	    while (dscbin_next_row(r, &label1) > 0)
+ *		while (dscbin_next_cell(r, &label2, &count) > 0)
+ *		    ...;
+ *	dscbin_close(r);
+ *
+ * Rows and cells that are not read are skipped.  Strings returned
+ * stay valid until the next dscbin_next_array() call.  The next_
+ * functions return 1 for an item, 0 at the end and -1 on errors.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define DSCBIN_MAGIC "DSCB"
+#define DSCBIN_VERSION 1
+
+typedef struct {
+    const char *name;
+    unsigned int start_time;
+    unsigned int stop_time;
+    const char *d1_type;
+    const char *d2_type;
+} dscbin_array;
+
+typedef struct _dscbin_reader dscbin_reader;
+
+dscbin_reader *dscbin_open(FILE *);
+int dscbin_next_array(dscbin_reader *, dscbin_array *);
+int dscbin_next_row(dscbin_reader *, const char **label);
+int dscbin_next_cell(dscbin_reader *, const char **label, uint64_t *count);
+void dscbin_close(dscbin_reader *);
+
+/*
+ * Writing mirrors reading.  Nothing is written to the file until
+ * dscbin_finish_array(), since arrays are length prefixed.  The
+ * functions return 0 on success and -1 on errors.
+ */
+
+typedef struct _dscbin_writer dscbin_writer;
+
+dscbin_writer *dscbin_create(FILE *);
+int dscbin_start_array(dscbin_writer *, const dscbin_array *);
+int dscbin_start_row(dscbin_writer *, const char *label);
+int dscbin_cell(dscbin_writer *, const char *label, uint64_t count);
+int dscbin_end_row(dscbin_writer *);
+int dscbin_finish_array(dscbin_writer *);
+void dscbin_free(dscbin_writer *);
+
+#endif /* DSCBIN_H */
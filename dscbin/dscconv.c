@@ -0,0 +1,382 @@
+/*
+ * Converts dsc data files between the XML and binary formats.
+ *
+ *	dscconv [-b | -x] [infile [outfile]]
+ *
+ * -b converts XML to binary, -x binary to XML.  Without either, the
+ * input's format is detected and it is converted to the other one.
+ * Converting a file there and back gives the same file again.
+ *
+ * Only XML as dsc writes it (one element per line) is understood.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "dscbin.h"
+
+static const char base64_chars[] =
+"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char *entity_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+"0123456789._-:";
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: dscconv [-b | -x] [infile [outfile]]\n");
+    exit(1);
+}
+
+/* ==== BINARY TO XML ===================================================== */
+
+/*
+ * Prints val="label" the way dsc's XML printer does.
+ */
+static void
+print_label(FILE *fp, const char *l)
+{
+    const unsigned char *q = (const unsigned char *) l;
+    size_t size = strlen(l);
+    size_t i;
+    if (strspn(l, entity_chars) == size) {
+	fprintf(fp, " val=\"%s\"", l);
+	return;
+    }
+    fputs(" val=\"", fp);
+    for (i = 0; i < size; i += 3) {
+	unsigned int c = q[i] << 16;
+	if (i + 1 < size)
+	    c |= q[i + 1] << 8;
+	if (i + 2 < size)
+	    c |= q[i + 2];
+	putc(base64_chars[c >> 18], fp);
+	putc(base64_chars[(c >> 12) & 0x3f], fp);
+	putc(i + 1 < size ? base64_chars[(c >> 6) & 0x3f] : '=', fp);
+	putc(i + 2 < size ? base64_chars[c & 0x3f] : '=', fp);
+    }
+    fputs("\" base64=\"1\"", fp);
+}
+
+static int
+bin_to_xml(FILE *in, FILE *out)
+{
+    dscbin_reader *r = dscbin_open(in);
+    dscbin_array a;
+    const char *label1;
+    const char *label2;
+    uint64_t count;
+    int x;
+    if (NULL == r) {
+	warnx("not a binary dsc data file");
+	return 1;
+    }
+    fprintf(out, "<dscdata>\n");
+    while ((x = dscbin_next_array(r, &a)) > 0) {
+	fprintf(out, "<array name=\"%s\" dimensions=\"2\""
+	    " start_time=\"%u\" stop_time=\"%u\">\n",
+	    a.name, a.start_time, a.stop_time);
+	fprintf(out, "  <dimension number=\"1\" type=\"%s\"/>\n", a.d1_type);
+	fprintf(out, "  <dimension number=\"2\" type=\"%s\"/>\n", a.d2_type);
+	fprintf(out, "  <data>\n");
+	while ((x = dscbin_next_row(r, &label1)) > 0) {
+	    fprintf(out, "    <%s", a.d1_type);
+	    print_label(out, label1);
+	    fprintf(out, ">\n");
+	    while ((x = dscbin_next_cell(r, &label2, &count)) > 0) {
+		fprintf(out, "      <%s", a.d2_type);
+		print_label(out, label2);
+		fprintf(out, " count=\"%" PRIu64 "\"/>\n", count);
+	    }
+	    if (x < 0)
+		break;
+	    fprintf(out, "    </%s>\n", a.d1_type);
+	}
+	if (x < 0)
+	    break;
+	fprintf(out, "  </data>\n");
+	fprintf(out, "</array>\n");
+    }
+    dscbin_close(r);
+    if (x < 0) {
+	warnx("truncated or corrupt binary data file");
+	return 1;
+    }
+    fprintf(out, "</dscdata>\n");
+    return 0;
+}
+
+/* ==== XML TO BINARY ===================================================== */
+
+#define MAX_ATTRS 8
+
+/*
+ * One element: <name attr="value" ...>, </name> or <name .../>.
+ * Values point into the line, which is modified.
+ */
+typedef struct {
+    char *name;
+    int closing;
+    int empty;
+    int nattrs;
+    char *attr[MAX_ATTRS];
+    char *value[MAX_ATTRS];
+} element;
+
+static int
+parse_element(char *line, element *e)
+{
+    char *p = strchr(line, '<');
+    memset(e, 0, sizeof(*e));
+    if (NULL == p)
+	return -1;
+    p++;
+    if ('/' == *p) {
+	e->closing = 1;
+	p++;
+    }
+    e->name = p;
+    p += strcspn(p, " \t/>");
+    for (;;) {
+	char *q;
+	while (' ' == *p || '\t' == *p)
+	    *p++ = '\0';
+	if ('/' == *p) {
+	    e->empty = 1;
+	    *p++ = '\0';
+	}
+	if ('>' == *p) {
+	    *p = '\0';
+	    return 0;
+	}
+	if ('\0' == *p || e->nattrs == MAX_ATTRS)
+	    return -1;
+	e->attr[e->nattrs] = p;
+	if (NULL == (q = strchr(p, '=')) || '"' != q[1])
+	    return -1;
+	*q = '\0';
+	e->value[e->nattrs] = q + 2;
+	if (NULL == (p = strchr(q + 2, '"')))
+	    return -1;
+	*p++ = '\0';
+	e->nattrs++;
+    }
+}
+
+static const char *
+attr(const element *e, const char *name)
+{
+    int i;
+    for (i = 0; i < e->nattrs; i++)
+	if (0 == strcmp(e->attr[i], name))
+	    return e->value[i];
+    return NULL;
+}
+
+static unsigned int
+uint_attr(const element *e, const char *name)
+{
+    const char *v = attr(e, name);
+    return v ? strtoul(v, NULL, 10) : 0;
+}
+
+/*
+ * Decodes base64 in place.
+ */
+static int
+base64_decode(char *s)
+{
+    char *d = s;
+    unsigned int c = 0;
+    int n = 0;
+    for (; *s && '=' != *s; s++) {
+	const char *p = strchr(base64_chars, *s);
+	if (NULL == p)
+	    return -1;
+	c = (c << 6) | (p - base64_chars);
+	if (++n == 4) {
+	    *d++ = c >> 16;
+	    *d++ = c >> 8;
+	    *d++ = c;
+	    c = n = 0;
+	}
+    }
+    if (n == 2) {
+	*d++ = c >> 4;
+    } else if (n == 3) {
+	*d++ = c >> 10;
+	*d++ = c >> 2;
+    } else if (n) {
+	return -1;
+    }
+    *d = '\0';
+    return 0;
+}
+
+static const char *
+label(const element *e)
+{
+    char *v = (char *) attr(e, "val");
+    const char *b = attr(e, "base64");
+    if (v && b && 0 == strcmp(b, "1") && base64_decode(v) < 0)
+	return NULL;
+    return v;
+}
+
+/*
+ * The array's header is known once its dimensions are; it is written
+ * before the first row (or at the end, for arrays without rows).
+ */
+static void
+start_array(dscbin_writer *w, dscbin_array *a, const char *name,
+    const char *d1_type, const char *d2_type, int *in_array)
+{
+    if (*in_array > 1)
+	return;
+    a->name = name;
+    a->d1_type = d1_type;
+    a->d2_type = d2_type;
+    if (dscbin_start_array(w, a) < 0)
+	err(1, "out of memory");
+    *in_array = 2;
+}
+
+static int
+xml_to_bin(FILE *in, FILE *out)
+{
+    dscbin_writer *w = dscbin_create(out);
+    dscbin_array a;
+    element e;
+    char *line = NULL;
+    size_t sz = 0;
+    char *name = NULL;
+    char *d1_type = NULL;
+    char *d2_type = NULL;
+    int lineno = 0;
+    int in_array = 0;
+    int in_row = 0;
+    if (NULL == w) {
+	warnx("cannot write binary data file");
+	return 1;
+    }
+    while (getline(&line, &sz, in) > 0) {
+	const char *l;
+	const char *v;
+	int bad = 0;
+	lineno++;
+	if (parse_element(line, &e) < 0) {
+	    warnx("line %d: cannot parse", lineno);
+	    return 1;
+	}
+	if (0 == strcmp(e.name, "dscdata") || 0 == strcmp(e.name, "data"))
+	    continue;
+	if (!in_array) {
+	    if (e.closing || strcmp(e.name, "array"))
+		bad = 1;
+	    else if (NULL == (v = attr(&e, "name")) || NULL == (name = strdup(v)))
+		bad = 1;
+	    else {
+		a.start_time = uint_attr(&e, "start_time");
+		a.stop_time = uint_attr(&e, "stop_time");
+		in_array = 1;
+	    }
+	} else if (0 == strcmp(e.name, "dimension")) {
+	    v = attr(&e, "type");
+	    l = attr(&e, "number");
+	    if (NULL == v || NULL == l)
+		bad = 1;
+	    else if (0 == strcmp(l, "1"))
+		d1_type = strdup(v);
+	    else if (0 == strcmp(l, "2"))
+		d2_type = strdup(v);
+	    else
+		bad = 1;
+	} else if (NULL == d1_type || NULL == d2_type) {
+	    bad = 1;
+	} else if (e.closing && 0 == strcmp(e.name, "array") && !in_row) {
+	    start_array(w, &a, name, d1_type, d2_type, &in_array);
+	    if (dscbin_finish_array(w) < 0)
+		err(1, "write");
+	    free(name);
+	    free(d1_type);
+	    free(d2_type);
+	    name = d1_type = d2_type = NULL;
+	    in_array = 0;
+	} else if (!in_row && 0 == strcmp(e.name, d1_type) && !e.closing) {
+	    if (NULL == (l = label(&e)))
+		bad = 1;
+	    else {
+		start_array(w, &a, name, d1_type, d2_type, &in_array);
+		if (dscbin_start_row(w, l) < 0)
+		    err(1, "out of memory");
+		in_row = 1;
+	    }
+	} else if (in_row && e.closing && 0 == strcmp(e.name, d1_type)) {
+	    if (dscbin_end_row(w) < 0)
+		err(1, "out of memory");
+	    in_row = 0;
+	} else if (in_row && e.empty && 0 == strcmp(e.name, d2_type)) {
+	    if (NULL == (l = label(&e)) || NULL == (v = attr(&e, "count")))
+		bad = 1;
+	    else if (dscbin_cell(w, l, strtoull(v, NULL, 10)) < 0)
+		err(1, "out of memory");
+	} else {
+	    bad = 1;
+	}
+	if (bad) {
+	    warnx("line %d: unexpected <%s%s>", lineno, e.closing ? "/" : "", e.name);
+	    return 1;
+	}
+    }
+    free(line);
+    dscbin_free(w);
+    if (in_array) {
+	warnx("truncated XML data file");
+	return 1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    FILE *out = stdout;
+    int to = 0;
+    int x;
+    int c;
+
+    while ((x = getopt(argc, argv, "bx")) != -1) {
+	switch (x) {
+	case 'b':
+	case 'x':
+	    to = x;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc > 2)
+	usage();
+    if (argc > 0 && NULL == (in = fopen(argv[0], "r")))
+	err(1, "%s", argv[0]);
+    if (argc > 1 && NULL == (out = fopen(argv[1], "w")))
+	err(1, "%s", argv[1]);
+    if (0 == to) {
+	if ((c = getc(in)) == EOF)
+	    errx(1, "empty input");
+	ungetc(c, in);
+	to = '<' == c ? 'b' : 'x';
+    }
+    x = 'b' == to ? xml_to_bin(in, out) : bin_to_xml(in, out);
+    if (fclose(out) != 0)
+	err(1, "write");
+    return x;
+}
@@ -0,0 +1,204 @@
+/*
+ * Shows dsc's live counters (live_stats) as they come in.
+ *
+ *	dsclive [-1] [-s seconds] file
+ *
+ * Prints a line of per-second rates, averaged over the last 'seconds'
+ * (1 by default), each time a second is over.  -1 prints one line and
+ * exits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "live.h"
+
+static const char *rcode_names[LIVE_RCODES] = {
+    "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED",
+};
+
+static const struct {
+    int qtype;
+    const char *name;
+} qtype_names[] = {
+    { 1, "A" }, { 2, "NS" }, { 5, "CNAME" }, { 6, "SOA" }, { 12, "PTR" },
+    { 15, "MX" }, { 16, "TXT" }, { 28, "AAAA" }, { 33, "SRV" }, { 43, "DS" },
+    { 46, "RRSIG" }, { 48, "DNSKEY" }, { 64, "SVCB" }, { 65, "HTTPS" },
+    { 255, "ANY" }, { 0, NULL }
+};
+
+#define TOP_N 4
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: dsclive [-1] [-s seconds] file\n");
+    exit(1);
+}
+
+static const live_segment *
+live_map(const char *path)
+{
+    const live_segment *seg;
+    struct stat sb;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+	err(1, "%s", path);
+    if (fstat(fd, &sb) < 0)
+	err(1, "%s", path);
+    if (sb.st_size < (off_t) sizeof(*seg))
+	errx(1, "%s: not a dsc live_stats file", path);
+    seg = mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == seg)
+	err(1, "mmap %s", path);
+    close(fd);
+    if (LIVE_MAGIC != seg->magic || sizeof(*seg) != seg->size)
+	errx(1, "%s: not a dsc live_stats file", path);
+    if (LIVE_VERSION != seg->version)
+	errx(1, "%s: version %u, expected %u", path, seg->version, LIVE_VERSION);
+    return seg;
+}
+
+/*
+ * Adds up the n seconds up to the latest one, under the seqlock.
+ * Returns the latest second.
+ */
+static uint32_t
+live_read(const live_segment *seg, int n, live_second *sum)
+{
+    uint32_t s;
+    uint32_t last;
+    int i;
+    int j;
+    do {
+	while ((s = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE)) & 1);
+	memset(sum, 0, sizeof(*sum));
+	last = seg->last;
+	for (i = 0; i < n; i++) {
+	    const live_second *l = &seg->slot[(last - i) % LIVE_SLOTS];
+	    if (l->sec != last - i)
+		continue;	/* no traffic that second */
+	    sum->packets += l->packets;
+	    sum->queries += l->queries;
+	    sum->responses += l->responses;
+	    sum->drops += l->drops;
+	    for (j = 0; j < LIVE_RCODES; j++)
+		sum->rcode[j] += l->rcode[j];
+	    for (j = 0; j < LIVE_QTYPES; j++)
+		sum->qtype[j] += l->qtype[j];
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (s != __atomic_load_n(&seg->seq, __ATOMIC_RELAXED));
+    return last;
+}
+
+static const char *
+qtype_name(int qt, char *buf, size_t len)
+{
+    int i;
+    for (i = 0; qtype_names[i].name; i++)
+	if (qtype_names[i].qtype == qt)
+	    return qtype_names[i].name;
+    if (qt == LIVE_QTYPES - 1)
+	snprintf(buf, len, "%d+", qt);
+    else
+	snprintf(buf, len, "%d", qt);
+    return buf;
+}
+
+/*
+ * Prints the TOP_N largest of counts[0..n) as name=rate.
+ */
+static void
+print_top(const uint64_t *counts, int n, int secs, int qtypes)
+{
+    int shown[TOP_N];
+    int i;
+    int k;
+    for (k = 0; k < TOP_N; k++) {
+	int best = -1;
+	char buf[16];
+	for (i = 0; i < n; i++) {
+	    int j;
+	    for (j = 0; j < k && shown[j] != i; j++);
+	    if (j < k || 0 == counts[i])
+		continue;
+	    if (best < 0 || counts[i] > counts[best])
+		best = i;
+	}
+	if (best < 0)
+	    break;
+	shown[k] = best;
+	if (qtypes)
+	    printf(" %s", qtype_name(best, buf, sizeof(buf)));
+	else if (rcode_names[best])
+	    printf(" %s", rcode_names[best]);
+	else
+	    printf(" rcode%d", best);
+	printf("=%.0f", (double) counts[best] / secs);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    const live_segment *seg;
+    live_second sum;
+    uint32_t shown = 0;
+    int secs = 1;
+    int once = 0;
+    int x;
+
+    while ((x = getopt(argc, argv, "1s:")) != -1) {
+	switch (x) {
+	case '1':
+	    once = 1;
+	    break;
+	case 's':
+	    secs = atoi(optarg);
+	    if (secs < 1 || secs > LIVE_SLOTS)
+		errx(1, "-s takes 1 to %d seconds", LIVE_SLOTS);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 1)
+	usage();
+    seg = live_map(argv[0]);
+
+    printf("%-8s %10s %10s %10s %8s  %s\n", "time", "pkts/s", "queries/s",
+	"replies/s", "drops/s", "top rcodes / qtypes");
+    for (;;) {
+	uint32_t last = live_read(seg, secs, &sum);
+	if (last != shown) {
+	    time_t t = last;
+	    char tbuf[16];
+	    strftime(tbuf, sizeof(tbuf), "%H:%M:%S", localtime(&t));
+	    printf("%-8s %10.0f %10.0f %10.0f %8.0f ", tbuf,
+		(double) sum.packets / secs, (double) sum.queries / secs,
+		(double) sum.responses / secs, (double) sum.drops / secs);
+	    print_top(sum.rcode, LIVE_RCODES, secs, 0);
+	    printf(" /");
+	    print_top(sum.qtype, LIVE_QTYPES, secs, 1);
+	    printf("\n");
+	    fflush(stdout);
+	    shown = last;
+	    if (once)
+		break;
+	}
+	usleep(200000);
+    }
+    return 0;
+}
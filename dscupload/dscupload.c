@@ -0,0 +1,1042 @@
+/*
+ * Ships dsc's data files to one or more presenters, in place of the
+ * cron scripts (upload-prep and upload-{rsync,x509,ssh}.sh).
+ *
+ *	dscupload [-dr] [-N node] [-c certdir] [-n files] [-w seconds]
+ *	    [-b min[:max]] [-t seconds] run_dir dest ...
+ *
+ * Each dest is name=method:target, with method one of
+ *
+ *	rsync	target is [user@]host:path; files go to path/incoming/<date>/
+ *	x509	target is a URI; a tar file is uploaded with curl, using
+ *		certdir/<name>/<node>.pem and cacert.pem if they exist
+ *	ssh	target is [user@]host; a tar file goes to "dsc <node>", using
+ *		certdir/<name>/<node>.id if it exists
+ *
+ * New data files in run_dir are noticed with inotify (where there is
+ * none, by listing run_dir every few seconds), hard linked into
+ * upload/<name>/<date>/ for each destination, as upload-prep did, and
+ * removed from run_dir.  Each destination keeps an index of its queue,
+ * upload/<name>/.queue, with a line for each file queued (+) and sent
+ * (-), so the upload directories are not listed again; -r (or a
+ * missing index) rebuilds it from them, when moving over from the cron
+ * scripts, say.
+ *
+ * Destinations are sent to at the same time, a batch of at most
+ * 'files' (500) files of one day at a time: in one rsync run, or in
+ * one gzipped tar file (with an MD5s file for x509).  A file is
+ * removed once the other end has it: rsync succeeded, the x509 server
+ * answered "Stored <file>", or the ssh receiver answered
+ * "MD5 <md5> <file>" with the right digest.  After a failure, the
+ * destination is tried again after min (30) seconds, twice as long
+ * after each further failure, up to max (3600).  New files wait
+ * 'seconds' (-w, 5) for the rest of their interval's files.  A
+ * transfer still running after -t seconds (600) is sent SIGTERM, and
+ * SIGKILL if it is still there 10 seconds later.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <syslog.h>
+#include <poll.h>
+#include <dirent.h>
+#include <regex.h>
+#include <err.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <zlib.h>
+#include <md5.h>
+
+#define MAX_DESTS 16
+#define SCAN_SECS 5		/* without inotify */
+#define MAX_OUTPUT 65536	/* of a transfer command, kept for parsing */
+#define KILL_GRACE 10		/* seconds from SIGTERM to SIGKILL */
+
+enum { M_RSYNC, M_X509, M_SSH };
+static const char *methods[] = { "rsync", "x509", "ssh", NULL };
+
+/*
+ * Queued files, "<date>/<file>", sorted, so oldest first.
+ */
+typedef struct {
+    char **v;
+    int n;
+    int size;
+} namelist;
+
+typedef struct {
+    char *name;
+    int method;
+    char *target;
+    char dir[256];		/* upload/<name> */
+    namelist queue;
+    FILE *index;
+    int index_lines;
+    /* the transfer in progress */
+    pid_t pid;
+    int out;
+    char *outbuf;
+    size_t outlen;
+    time_t started;
+    int killed;			/* signals sent: SIGTERM, then SIGKILL */
+    int reaped;
+    int status;
+    char date[16];
+    int nbatch;
+    char (*md5)[33];
+    /* when to try next */
+    time_t next_try;
+    int backoff;
+} dest;
+
+static dest dests[MAX_DESTS];
+static int ndests = 0;
+static const char *node = NULL;
+static const char *certdir = "/usr/local/dsc/certs";
+static int batch_max = 500;
+static int settle = 5;
+static int backoff_min = 30;
+static int backoff_max = 3600;
+static int timeout = 600;
+static regex_t data_re;
+static volatile sig_atomic_t stop = 0;
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: dscupload [-dr] [-N node] [-c certdir] [-n files] [-w seconds]\n"
+	"\t[-b min[:max]] [-t seconds] run_dir name=method:target ...\n");
+    exit(1);
+}
+
+/* ==== QUEUES ============================================================ */
+
+static int
+namelist_find(const namelist *l, const char *s, int *at)
+{
+    int lo = 0;
+    int hi = l->n;
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+	int c = strcmp(l->v[mid], s);
+	if (0 == c) {
+	    *at = mid;
+	    return 1;
+	}
+	if (c < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    *at = lo;
+    return 0;
+}
+
+static int
+namelist_add(namelist *l, const char *s)
+{
+    int at;
+    if (namelist_find(l, s, &at))
+	return 0;
+    if (l->n == l->size) {
+	l->size = l->size ? l->size * 2 : 256;
+	if (NULL == (l->v = realloc(l->v, l->size * sizeof(*l->v))))
+	    err(1, "realloc");
+    }
+    memmove(l->v + at + 1, l->v + at, (l->n - at) * sizeof(*l->v));
+    if (NULL == (l->v[at] = strdup(s)))
+	err(1, "strdup");
+    l->n++;
+    return 1;
+}
+
+/*
+ * Drops the entries set to NULL.
+ */
+static void
+namelist_compact(namelist *l)
+{
+    int i;
+    int j = 0;
+    for (i = 0; i < l->n; i++)
+	if (l->v[i])
+	    l->v[j++] = l->v[i];
+    l->n = j;
+}
+
+static int
+data_file(const char *f, time_t *t)
+{
+    regmatch_t m[2];
+    if (regexec(&data_re, f, 2, m, 0))
+	return 0;
+    *t = strtoul(f, NULL, 10);
+    return 1;
+}
+
+static void
+queue_scan(dest *d)
+{
+    DIR *dd;
+    DIR *fd;
+    struct dirent *e;
+    struct dirent *f;
+    char path[512];
+    time_t t;
+    if (NULL == (dd = opendir(d->dir)))
+	err(1, "%s", d->dir);
+    while ((e = readdir(dd))) {
+	if (strlen(e->d_name) != 10 || '-' != e->d_name[4] || '-' != e->d_name[7])
+	    continue;
+	snprintf(path, sizeof(path), "%s/%s", d->dir, e->d_name);
+	if (NULL == (fd = opendir(path)))
+	    continue;
+	while ((f = readdir(fd))) {
+	    if (!data_file(f->d_name, &t))
+		continue;
+	    snprintf(path, sizeof(path), "%s/%s", e->d_name, f->d_name);
+	    namelist_add(&d->queue, path);
+	}
+	closedir(fd);
+    }
+    closedir(dd);
+}
+
+/*
+ * Writes the index afresh, with only what is queued.
+ */
+static int
+index_rewrite(dest *d)
+{
+    char path[300];
+    char tpath[300];
+    FILE *fp;
+    int i;
+    snprintf(path, sizeof(path), "%s/.queue", d->dir);
+    snprintf(tpath, sizeof(tpath), "%s/.queue.new", d->dir);
+    if (NULL == (fp = fopen(tpath, "w"))) {
+	syslog(LOG_ERR, "%s: %s", tpath, strerror(errno));
+	return -1;
+    }
+    for (i = 0; i < d->queue.n; i++)
+	fprintf(fp, "+%s\n", d->queue.v[i]);
+    if (fclose(fp) != 0 || rename(tpath, path) < 0) {
+	syslog(LOG_ERR, "%s: %s", path, strerror(errno));
+	unlink(tpath);
+	return -1;
+    }
+    if (d->index)
+	fclose(d->index);
+    if (NULL == (d->index = fopen(path, "a"))) {
+	syslog(LOG_ERR, "%s: %s", path, strerror(errno));
+	exit(1);
+    }
+    d->index_lines = d->queue.n;
+    return 0;
+}
+
+static void
+index_load(dest *d, int rebuild)
+{
+    char path[300];
+    char line[512];
+    FILE *fp;
+    int at;
+    snprintf(path, sizeof(path), "%s/.queue", d->dir);
+    if (!rebuild && (fp = fopen(path, "r"))) {
+	while (fgets(line, sizeof(line), fp)) {
+	    line[strcspn(line, "\n")] = '\0';
+	    if ('+' == line[0])
+		namelist_add(&d->queue, line + 1);
+	    else if ('-' == line[0] && namelist_find(&d->queue, line + 1, &at)) {
+		free(d->queue.v[at]);
+		memmove(d->queue.v + at, d->queue.v + at + 1,
+		    (d->queue.n - at - 1) * sizeof(*d->queue.v));
+		d->queue.n--;
+	    }
+	}
+	fclose(fp);
+    } else {
+	queue_scan(d);
+    }
+    if (index_rewrite(d) < 0)
+	exit(1);
+}
+
+/*
+ * Queues a new data file in run_dir for every destination, and
+ * removes it from run_dir once it is queued everywhere.
+ */
+static void
+ingest(const char *f)
+{
+    char date[16];
+    char path[512];
+    time_t t;
+    time_t now = time(NULL);
+    int ok = 1;
+    int i;
+    if (!data_file(f, &t))
+	return;
+    strftime(date, sizeof(date), "%Y-%m-%d", gmtime(&t));
+    for (i = 0; i < ndests; i++) {
+	dest *d = &dests[i];
+	snprintf(path, sizeof(path), "%s/%s", d->dir, date);
+	if (mkdir(path, 0775) < 0 && EEXIST != errno) {
+	    syslog(LOG_ERR, "mkdir %s: %s", path, strerror(errno));
+	    ok = 0;
+	    continue;
+	}
+	snprintf(path, sizeof(path), "%s/%s/%s", d->dir, date, f);
+	if (link(f, path) < 0 && EEXIST != errno) {
+	    syslog(LOG_ERR, "link %s %s: %s", f, path, strerror(errno));
+	    ok = 0;
+	    continue;
+	}
+	snprintf(path, sizeof(path), "%s/%s", date, f);
+	if (namelist_add(&d->queue, path)) {
+	    fprintf(d->index, "+%s\n", path);
+	    fflush(d->index);
+	    d->index_lines++;
+	}
+	if (0 == d->pid && d->next_try < now + settle)
+	    d->next_try = now + settle;
+    }
+    if (ok && unlink(f) < 0)
+	syslog(LOG_ERR, "unlink %s: %s", f, strerror(errno));
+}
+
+static void
+ingest_scan(void)
+{
+    DIR *dd = opendir(".");
+    struct dirent *e;
+    if (NULL == dd) {
+	syslog(LOG_ERR, "run_dir: %s", strerror(errno));
+	return;
+    }
+    while ((e = readdir(dd)))
+	ingest(e->d_name);
+    closedir(dd);
+}
+
+/* ==== TAR FILES ========================================================= */
+
+static void
+tar_octal(unsigned char *field, int len, unsigned long v)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%0*lo", len - 1, v);
+    memcpy(field, buf, len);
+}
+
+static int
+tar_header(gzFile gz, const char *name, unsigned long size, time_t mtime)
+{
+    unsigned char h[512];
+    unsigned long sum = 0;
+    int i;
+    memset(h, 0, sizeof(h));
+    strncpy((char *) h, name, 99);
+    tar_octal(h + 100, 8, 0644);
+    tar_octal(h + 108, 8, 0);
+    tar_octal(h + 116, 8, 0);
+    tar_octal(h + 124, 12, size);
+    tar_octal(h + 136, 12, mtime);
+    memset(h + 148, ' ', 8);
+    h[156] = '0';
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+    for (i = 0; i < 512; i++)
+	sum += h[i];
+    tar_octal(h + 148, 7, sum);
+    return gzwrite(gz, h, 512) == 512 ? 0 : -1;
+}
+
+static int
+tar_pad(gzFile gz, unsigned long size)
+{
+    static const char zero[512];
+    int n = (512 - size % 512) % 512;
+    return n && gzwrite(gz, zero, n) != n ? -1 : 0;
+}
+
+static int
+tar_end(gzFile gz)
+{
+    static const char zero[1024];
+    return gzwrite(gz, zero, sizeof(zero)) == sizeof(zero) ? 0 : -1;
+}
+
+static int
+tar_add_mem(gzFile gz, const char *name, const char *buf, size_t len)
+{
+    if (tar_header(gz, name, len, time(NULL)) < 0)
+	return -1;
+    if (len && gzwrite(gz, buf, len) != (int) len)
+	return -1;
+    return tar_pad(gz, len);
+}
+
+static int
+tar_add_file(gzFile gz, const char *name, const char *path)
+{
+    char buf[65536];
+    struct stat sb;
+    unsigned long left;
+    ssize_t x;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &sb) < 0 || tar_header(gz, name, sb.st_size, sb.st_mtime) < 0) {
+	if (fd >= 0)
+	    close(fd);
+	return -1;
+    }
+    for (left = sb.st_size; left; left -= x) {
+	x = read(fd, buf, left < sizeof(buf) ? left : sizeof(buf));
+	if (x <= 0 || gzwrite(gz, buf, x) != x) {
+	    close(fd);
+	    return -1;
+	}
+    }
+    close(fd);
+    return tar_pad(gz, sb.st_size);
+}
+
+static int
+file_md5(const char *path, char *hash)
+{
+    char buf[65536];
+    MD5_CTX md5;
+    ssize_t x;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return -1;
+    MD5Init(&md5);
+    while ((x = read(fd, buf, sizeof(buf))) > 0)
+	MD5Update(&md5, (unsigned char *) buf, x);
+    close(fd);
+    if (x < 0)
+	return -1;
+    MD5End(&md5, hash);
+    return 0;
+}
+
+/*
+ * Writes the batch to upload/<name>/.batch.tar.gz.
+ */
+static int
+archive_write(dest *d, const char *archive)
+{
+    char path[512];
+    char *md5s = NULL;
+    size_t md5s_len = 0;
+    FILE *mfp;
+    gzFile gz;
+    int i;
+    if (NULL == (d->md5 = realloc(d->md5, d->nbatch * sizeof(*d->md5))))
+	err(1, "realloc");
+    if (NULL == (mfp = open_memstream(&md5s, &md5s_len)))
+	err(1, "open_memstream");
+    for (i = 0; i < d->nbatch; i++) {
+	snprintf(path, sizeof(path), "%s/%s", d->dir, d->queue.v[i]);
+	if (file_md5(path, d->md5[i]) < 0) {
+	    syslog(LOG_ERR, "%s: %s", path, strerror(errno));
+	    fclose(mfp);
+	    free(md5s);
+	    return -1;
+	}
+	fprintf(mfp, "%s  %s\n", d->md5[i], d->queue.v[i] + 11);
+    }
+    fclose(mfp);
+    if (NULL == (gz = gzopen(archive, "wb"))) {
+	syslog(LOG_ERR, "%s: %s", archive, strerror(errno));
+	free(md5s);
+	return -1;
+    }
+    if (M_X509 == d->method && tar_add_mem(gz, "MD5s", md5s, md5s_len) < 0)
+	goto fail;
+    for (i = 0; i < d->nbatch; i++) {
+	snprintf(path, sizeof(path), "%s/%s", d->dir, d->queue.v[i]);
+	if (tar_add_file(gz, d->queue.v[i] + 11, path) < 0)
+	    goto fail;
+    }
+    if (tar_end(gz) < 0 || gzclose(gz) != Z_OK) {
+	gz = NULL;
+	goto fail;
+    }
+    free(md5s);
+    return 0;
+  fail:
+    syslog(LOG_ERR, "%s: write failed", archive);
+    if (gz)
+	gzclose(gz);
+    unlink(archive);
+    free(md5s);
+    return -1;
+}
+
+/* ==== TRANSFERS ========================================================= */
+
+static void
+retry_later(dest *d)
+{
+    if (0 == d->backoff)
+	d->backoff = backoff_min;
+    else if ((d->backoff *= 2) > backoff_max)
+	d->backoff = backoff_max;
+    d->next_try = time(NULL) + d->backoff + random() % (d->backoff / 4 + 1);
+}
+
+static void
+dequeue(dest *d, int i)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", d->dir, d->queue.v[i]);
+    if (unlink(path) < 0 && ENOENT != errno)
+	syslog(LOG_ERR, "unlink %s: %s", path, strerror(errno));
+    fprintf(d->index, "-%s\n", d->queue.v[i]);
+    d->index_lines++;
+    free(d->queue.v[i]);
+    d->queue.v[i] = NULL;
+}
+
+/*
+ * The batch is the queue's oldest files of one day.  Files gone from
+ * the queue directory are dropped first.
+ */
+static int
+batch_pick(dest *d)
+{
+    char path[512];
+    struct stat sb;
+    int i;
+    for (i = 0; i < d->queue.n && i < batch_max; i++) {
+	snprintf(path, sizeof(path), "%s/%s", d->dir, d->queue.v[i]);
+	if (stat(path, &sb) < 0 && ENOENT == errno) {
+	    syslog(LOG_NOTICE, "%s: gone, dropped from the queue", path);
+	    dequeue(d, i);
+	}
+    }
+    namelist_compact(&d->queue);
+    fflush(d->index);
+    for (i = 0; i < d->queue.n && i < batch_max; i++)
+	if (strncmp(d->queue.v[i], d->queue.v[0], 11))
+	    break;
+    return d->nbatch = i;
+}
+
+static void
+transfer_start(dest *d)
+{
+    char archive[300];
+    char cert[3][512];
+    char login[256];
+    char **argv;
+    struct stat sb;
+    int argc = 0;
+    int p[2];
+    int in;
+    int i;
+
+    if (0 == batch_pick(d))
+	return;
+    memcpy(d->date, d->queue.v[0], 10);
+    d->date[10] = '\0';
+    snprintf(archive, sizeof(archive), "%s/.batch.tar.gz", d->dir);
+    if (M_RSYNC != d->method && archive_write(d, archive) < 0) {
+	retry_later(d);
+	return;
+    }
+    if (NULL == (argv = calloc(d->nbatch + 16, sizeof(*argv))))
+	err(1, "calloc");
+    snprintf(cert[0], sizeof(cert[0]), "%s/%s/%s.pem", certdir, d->name, node);
+    snprintf(cert[1], sizeof(cert[1]), "%s/%s/cacert.pem", certdir, d->name);
+    snprintf(cert[2], sizeof(cert[2]), "%s/%s/%s.id", certdir, d->name, node);
+    switch (d->method) {
+    case M_RSYNC:
+	argv[argc++] = "rsync";
+	argv[argc++] = "-a";
+	argv[argc++] = "--";
+	for (i = 0; i < d->nbatch; i++)
+	    argv[argc++] = d->queue.v[i] + 11;
+	snprintf(login, sizeof(login), "%s/incoming/%s/", d->target, d->date);
+	argv[argc++] = login;
+	break;
+    case M_X509:
+	argv[argc++] = "curl";
+	argv[argc++] = "--silent";
+	argv[argc++] = "--show-error";
+	if (0 == stat(cert[0], &sb)) {
+	    argv[argc++] = "--cert";
+	    argv[argc++] = cert[0];
+	}
+	if (0 == stat(cert[1], &sb)) {
+	    argv[argc++] = "--cacert";
+	    argv[argc++] = cert[1];
+	}
+	argv[argc++] = "--upload-file";
+	argv[argc++] = archive;
+	argv[argc++] = d->target;
+	break;
+    case M_SSH:
+	argv[argc++] = "ssh";
+	if (0 == stat(cert[2], &sb)) {
+	    argv[argc++] = "-i";
+	    argv[argc++] = cert[2];
+	}
+	argv[argc++] = d->target;
+	/* dsc receiver doesn't like + in filename */
+	snprintf(login, sizeof(login), "dsc %s", node);
+	for (i = 4; login[i]; i++)
+	    if ('+' == login[i])
+		login[i] = '_';
+	argv[argc++] = login;
+	break;
+    }
+    in = open(M_SSH == d->method ? archive : "/dev/null", O_RDONLY);
+    if (in < 0 || pipe(p) < 0) {
+	syslog(LOG_ERR, "%s: %s", d->name, strerror(errno));
+	if (in >= 0)
+	    close(in);
+	free(argv);
+	retry_later(d);
+	return;
+    }
+    switch (d->pid = fork()) {
+    case -1:
+	syslog(LOG_ERR, "fork: %s", strerror(errno));
+	close(p[0]);
+	close(p[1]);
+	close(in);
+	d->pid = 0;
+	free(argv);
+	retry_later(d);
+	return;
+    case 0:
+	setpgid(0, 0);		/* to be killed with whatever it runs */
+	dup2(in, 0);
+	dup2(p[1], 1);
+	dup2(p[1], 2);
+	close(p[0]);
+	if (M_RSYNC == d->method) {
+	    snprintf(archive, sizeof(archive), "%s/%s", d->dir, d->date);
+	    if (chdir(archive) < 0)
+		_exit(127);
+	}
+	execvp(argv[0], argv);
+	fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+	_exit(127);
+    }
+    close(in);
+    close(p[1]);
+    free(argv);
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+    d->out = p[0];
+    d->outlen = 0;
+    d->started = time(NULL);
+    d->killed = 0;
+    d->reaped = 0;
+}
+
+/*
+ * Marks the files the other end says it has.
+ */
+static int
+transfer_taken(dest *d, int ok, char *taken)
+{
+    char word[64];
+    char md5[64];
+    char file[256];
+    char *line;
+    int n = 0;
+    int i;
+    if (M_RSYNC == d->method) {
+	memset(taken, ok, d->nbatch);
+	return ok ? d->nbatch : 0;
+    }
+    for (line = strtok(d->outbuf, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+	if (M_X509 == d->method) {
+	    if (2 != sscanf(line, "%63s %255s", word, file) || strcmp(word, "Stored"))
+		continue;
+	} else {
+	    if (3 != sscanf(line, "%63s %63s %255s", word, md5, file) || strcmp(word, "MD5"))
+		continue;
+	    if (strchr(file, '/'))
+		continue;
+	}
+	for (i = 0; i < d->nbatch; i++) {
+	    if (taken[i] || strcmp(file, d->queue.v[i] + 11))
+		continue;
+	    if (M_SSH == d->method && strcmp(md5, d->md5[i]))
+		break;
+	    taken[i] = 1;
+	    n++;
+	    break;
+	}
+    }
+    return n;
+}
+
+static void
+transfer_done(dest *d, int status)
+{
+    char path[512];
+    char why[64];
+    char *taken;
+    int ok = WIFEXITED(status) && 0 == WEXITSTATUS(status);
+    int n;
+    int i;
+
+    d->outbuf[d->outlen] = '\0';
+    if (WIFEXITED(status))
+	snprintf(why, sizeof(why), "exit %d", WEXITSTATUS(status));
+    else
+	snprintf(why, sizeof(why), "signal %d", WTERMSIG(status));
+    if (NULL == (taken = calloc(d->nbatch, 1)))
+	err(1, "calloc");
+    if (!ok)
+	syslog(LOG_NOTICE, "%s: %s: %.*s", d->name, why,
+	    (int) strcspn(d->outbuf, "\n"), d->outbuf);
+    n = transfer_taken(d, ok, taken);
+    for (i = 0; i < d->nbatch; i++)
+	if (taken[i])
+	    dequeue(d, i);
+    free(taken);
+    fflush(d->index);
+    namelist_compact(&d->queue);
+    snprintf(path, sizeof(path), "%s/%s", d->dir, d->date);
+    rmdir(path);		/* once the day is done */
+    snprintf(path, sizeof(path), "%s/.batch.tar.gz", d->dir);
+    unlink(path);
+    if (ok && n == d->nbatch) {
+	syslog(LOG_INFO, "%s: sent %d files, %d queued", d->name, n, d->queue.n);
+	d->backoff = 0;
+	d->next_try = 0;
+    } else {
+	retry_later(d);
+	syslog(LOG_NOTICE, "%s: %d of %d files taken (%s), %d queued, next try in %ld s",
+	    d->name, n, d->nbatch, why, d->queue.n, (long) (d->next_try - time(NULL)));
+    }
+    if (d->index_lines > 2 * d->queue.n + 1000)
+	index_rewrite(d);
+    d->pid = 0;
+    d->out = -1;
+}
+
+/*
+ * Reads what the transfer command says, up to EOF.
+ */
+static void
+transfer_read(dest *d)
+{
+    char buf[4096];
+    ssize_t x;
+    while ((x = read(d->out, buf, sizeof(buf))) > 0) {
+	if (x > (ssize_t) (MAX_OUTPUT - d->outlen))
+	    x = MAX_OUTPUT - d->outlen;
+	memcpy(d->outbuf + d->outlen, buf, x);
+	d->outlen += x;
+    }
+    if (x < 0 && (EAGAIN == errno || EINTR == errno))
+	return;
+    close(d->out);
+    d->out = -1;
+}
+
+/*
+ * Reaps the transfer command without waiting for it, and kills it if
+ * it takes too long.  It is done once it has exited and its output
+ * is read; if what it ran keeps the output open after SIGKILL, that
+ * is given up on too.
+ */
+static void
+transfer_check(dest *d, time_t now)
+{
+    int status;
+    pid_t x;
+    if (!d->reaped) {
+	while ((x = waitpid(d->pid, &status, WNOHANG)) < 0 && EINTR == errno);
+	if (x == d->pid) {
+	    d->status = status;
+	    d->reaped = 1;
+	}
+    }
+    if (now >= d->started + timeout + d->killed * KILL_GRACE) {
+	switch (d->killed++) {
+	case 0:
+	    syslog(LOG_NOTICE, "%s: timed out after %d s", d->name, timeout);
+	    kill(-d->pid, SIGTERM);
+	    break;
+	case 1:
+	    syslog(LOG_NOTICE, "%s: still running, killing it", d->name);
+	    kill(-d->pid, SIGKILL);
+	    break;
+	default:
+	    d->killed = 2;
+	    if (d->reaped && d->out >= 0) {
+		close(d->out);
+		d->out = -1;
+	    }
+	    break;
+	}
+    }
+    if (d->reaped && d->out < 0)
+	transfer_done(d, d->status);
+}
+
+/*
+ * When transfer_check() has something to do next.
+ */
+static time_t
+transfer_wake(const dest *d, time_t now)
+{
+    if (d->out < 0 || 2 == d->killed)
+	return now + 1;		/* polling for it to exit */
+    return d->started + timeout + d->killed * KILL_GRACE;
+}
+
+/* ==== MAIN ============================================================== */
+
+static void
+dest_add(const char *spec)
+{
+    dest *d = &dests[ndests];
+    char *s;
+    char *m;
+    int i;
+    if (ndests == MAX_DESTS)
+	errx(1, "at most %d destinations", MAX_DESTS);
+    if (NULL == (s = strdup(spec)))
+	err(1, "strdup");
+    if (NULL == (m = strchr(s, '=')) || NULL == (d->target = strchr(m, ':')))
+	errx(1, "%s: expected name=method:target", spec);
+    *m++ = '\0';
+    *d->target++ = '\0';
+    if ('\0' == *s || strchr(s, '/') || '.' == *s)
+	errx(1, "%s: bad destination name", spec);
+    for (i = 0; methods[i] && strcmp(methods[i], m); i++);
+    if (NULL == methods[i])
+	errx(1, "%s: unknown method '%s'", spec, m);
+    d->name = s;
+    d->method = i;
+    d->out = -1;
+    snprintf(d->dir, sizeof(d->dir), "upload/%s", s);
+    if (NULL == (d->outbuf = malloc(MAX_OUTPUT + 1)))
+	err(1, "malloc");
+    ndests++;
+}
+
+static void
+on_signal(int sig)
+{
+    (void) sig;
+    stop = 1;
+}
+
+/*
+ * Only there to interrupt poll(), so that exited transfers are
+ * reaped at once.
+ */
+static void
+on_child(int sig)
+{
+    (void) sig;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *run_dir;
+    char path[512];
+    struct sigaction sa;
+    time_t last_scan = 0;
+    int debug = 0;
+    int rebuild = 0;
+    int ifd = -1;
+    int x;
+    int i;
+
+    while ((x = getopt(argc, argv, "drN:c:n:w:b:t:")) != -1) {
+	switch (x) {
+	case 'd':
+	    debug = 1;
+	    break;
+	case 'r':
+	    rebuild = 1;
+	    break;
+	case 'N':
+	    node = optarg;
+	    break;
+	case 'c':
+	    certdir = optarg;
+	    break;
+	case 'n':
+	    if ((batch_max = atoi(optarg)) < 1)
+		usage();
+	    break;
+	case 'w':
+	    settle = atoi(optarg);
+	    break;
+	case 'b':
+	    backoff_min = atoi(optarg);
+	    if (strchr(optarg, ':'))
+		backoff_max = atoi(strchr(optarg, ':') + 1);
+	    if (backoff_min < 1 || backoff_max < backoff_min)
+		usage();
+	    break;
+	case 't':
+	    if ((timeout = atoi(optarg)) < 1)
+		usage();
+	    break;
+	default:
+	    usage();
+	}
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 2)
+	usage();
+    run_dir = argv[0];
+    if (NULL == node)
+	node = strrchr(run_dir, '/') ? strrchr(run_dir, '/') + 1 : run_dir;
+    for (i = 1; i < argc; i++)
+	dest_add(argv[i]);
+    if (regcomp(&data_re, "^([0-9]+)\\.[A-Za-z0-9_]+\\.(xml|bin|jsonl)(\\.gz|\\.zst)?$", REG_EXTENDED))
+	errx(1, "regcomp");
+    if (chdir(run_dir) < 0)
+	err(1, "%s", run_dir);
+    snprintf(path, sizeof(path), "%s/.ssh/dsc_uploader_id", getenv("HOME") ? getenv("HOME") : "");
+    if (NULL == getenv("RSYNC_RSH") && 0 == access(path, R_OK)) {
+	char rsh[600];
+	snprintf(rsh, sizeof(rsh), "ssh -i %s", path);
+	setenv("RSYNC_RSH", rsh, 1);
+    }
+
+    openlog("dscupload", LOG_PID | (debug ? LOG_PERROR : 0), LOG_DAEMON);
+    if (mkdir("upload", 0775) < 0 && EEXIST != errno)
+	err(1, "%s/upload", run_dir);
+    for (i = 0; i < ndests; i++) {
+	if (mkdir(dests[i].dir, 0775) < 0 && EEXIST != errno)
+	    err(1, "%s/%s", run_dir, dests[i].dir);
+	index_load(&dests[i], rebuild);
+    }
+    if (!debug && daemon(1, 0) < 0)
+	err(1, "daemon");
+    srandom(time(NULL) ^ getpid());
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sa.sa_handler = on_child;
+    sigaction(SIGCHLD, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+#ifdef __linux__
+    if ((ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0
+	|| inotify_add_watch(ifd, ".", IN_MOVED_TO | IN_CLOSE_WRITE) < 0) {
+	syslog(LOG_ERR, "inotify: %s; listing run_dir instead", strerror(errno));
+	if (ifd >= 0)
+	    close(ifd);
+	ifd = -1;
+    }
+#endif
+    ingest_scan();
+    last_scan = time(NULL);
+    syslog(LOG_INFO, "running, %d destinations", ndests);
+
+    while (!stop) {
+	struct pollfd pfd[MAX_DESTS + 1];
+	dest *polled[MAX_DESTS + 1];
+	time_t now = time(NULL);
+	time_t wake = now + 60;
+	int n = 0;
+
+	if (ifd < 0 && now >= last_scan + SCAN_SECS) {
+	    ingest_scan();
+	    last_scan = now;
+	}
+	if (ifd < 0 && wake > last_scan + SCAN_SECS)
+	    wake = last_scan + SCAN_SECS;
+	if (ifd >= 0) {
+	    pfd[n].fd = ifd;
+	    pfd[n].events = POLLIN;
+	    polled[n++] = NULL;
+	}
+	for (i = 0; i < ndests; i++) {
+	    dest *d = &dests[i];
+	    if (d->pid)
+		transfer_check(d, now);
+	    if (0 == d->pid && d->queue.n && d->next_try <= now)
+		transfer_start(d);
+	    if (d->pid) {
+		if (d->out >= 0) {
+		    pfd[n].fd = d->out;
+		    pfd[n].events = POLLIN;
+		    polled[n++] = d;
+		}
+		if (wake > transfer_wake(d, now))
+		    wake = transfer_wake(d, now);
+	    } else if (d->queue.n && wake > d->next_try) {
+		wake = d->next_try;
+	    }
+	}
+	if (poll(pfd, n, wake > now ? (wake - now) * 1000 : 0) <= 0)
+	    continue;
+	for (i = 0; i < n; i++) {
+	    if (0 == pfd[i].revents)
+		continue;
+	    if (polled[i]) {
+		transfer_read(polled[i]);
+		continue;
+	    }
+#ifdef __linux__
+	    {
+		char buf[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+		ssize_t len;
+		char *p;
+		while ((len = read(ifd, buf, sizeof(buf))) > 0) {
+		    for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+			struct inotify_event *ev = (struct inotify_event *) p;
+			if (ev->mask & IN_Q_OVERFLOW)
+			    ingest_scan();
+			else if (ev->len)
+			    ingest(ev->name);
+		    }
+		}
+	    }
+#endif
+	}
+    }
+    for (i = 0; i < ndests; i++)
+	if (dests[i].pid)
+	    kill(-dests[i].pid, SIGTERM);
+    for (x = 0; x <= KILL_GRACE; x++) {
+	int running = 0;
+	for (i = 0; i < ndests; i++) {
+	    if (0 == dests[i].pid)
+		continue;
+	    if (0 != waitpid(dests[i].pid, NULL, WNOHANG))
+		dests[i].pid = 0;
+	    else if (KILL_GRACE == x)
+		kill(-dests[i].pid, SIGKILL);
+	    else
+		running++;
+	}
+	if (0 == running)
+	    break;
+	sleep(1);
+    }
+    syslog(LOG_INFO, "exiting");
+    return 0;
+}
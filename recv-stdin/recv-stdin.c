@@ -1,11 +1,15 @@
+#define _GNU_SOURCE		/* for syncfs() */
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <md5.h>
 #include <err.h>
+#include <errno.h>
 #include <string.h>
+#include <strings.h>
 
 /*
  * PV 2005-09-26
@@ -18,6 +22,190 @@
  * spool directory owned by a group all the members are in.
  */
 
+/*
+ * With -m, many files come in one session, each framed as
+ *
+ *	<name> <length>\n
+ *	<length bytes>
+ *	<md5 of those bytes>\n
+ *
+ * An empty line (or the end of input) ends a batch.  The batch's files
+ * are written under temporary names, synced to disk together, given
+ * their names, and then acknowledged together, one line each:
+ *
+ *	MD5 <md5> <name>	stored (or already there, the same)
+ *	BAD <md5> <name>	digest mismatch, not stored
+ *	ERR <md5> <name>	a different file by that name exists
+ *
+ * The sender may delete a file once it sees its MD5 line.  Names may
+ * not contain '/' or start with '.'.
+ */
+
+#define BATCH_MAX 1000
+#define IOBUF (1 << 20)
+
+struct received {
+	char name[256];
+	char tmp[256];		/* ".<name>.XXXXXX", within NAME_MAX */
+	char md5[33];
+	int good;
+};
+
+static struct received batch[BATCH_MAX];
+static int nbatch = 0;
+
+static int
+file_md5(const char *fn, char *hash_str)
+{
+	unsigned char buf[65536];
+	MD5_CTX md5;
+	int fd;
+	int n;
+
+	if ((fd = open(fn, O_RDONLY)) < 0)
+		return -1;
+	MD5Init(&md5);
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		MD5Update(&md5, buf, n);
+	close(fd);
+	MD5End(&md5, hash_str);
+	return n;
+}
+
+static void
+discard_batch(void)
+{
+	while (nbatch > 0)
+		unlink(batch[--nbatch].tmp);
+}
+
+/*
+ * Syncs the batch's files in one go, links them to their names, and
+ * acknowledges them.
+ */
+static void
+commit_batch(void)
+{
+	char hash_str[33];
+	const char *ack;
+	int dfd;
+	int i;
+
+	if (0 == nbatch)
+		return;
+	if ((dfd = open(".", O_RDONLY)) < 0)
+		err(1, "$HOME/dsc");
+#ifdef __linux__
+	if (syncfs(dfd) < 0)
+		err(1, "syncfs");
+#endif
+	for (i = 0; i < nbatch; i++) {
+		struct received *r = &batch[i];
+		if (!r->good)
+			continue;
+		if (link(r->tmp, r->name) < 0) {
+			if (EEXIST != errno)
+				err(1, "%s", r->name);
+			if (file_md5(r->name, hash_str) < 0 || strcmp(hash_str, r->md5))
+				r->good = -1;
+		}
+	}
+	if (fsync(dfd) < 0)
+		err(1, "fsync $HOME/dsc");
+	close(dfd);
+	for (i = 0; i < nbatch; i++) {
+		struct received *r = &batch[i];
+		unlink(r->tmp);
+		ack = r->good > 0 ? "MD5" : r->good < 0 ? "ERR" : "BAD";
+		printf("%s %s %s\n", ack, r->md5, r->name);
+	}
+	fflush(stdout);
+	nbatch = 0;
+}
+
+static void
+recv_many(void)
+{
+	static unsigned char buf[IOBUF];
+	char line[512];
+	char name[512];
+	char digest[64];
+	unsigned long long len;
+	unsigned long long left;
+	struct received *r;
+	MD5_CTX md5;
+	FILE *out;
+	size_t n;
+	size_t nlen;
+	int fd;
+
+	setvbuf(stdin, NULL, _IOFBF, IOBUF);
+	while (fgets(line, sizeof(line), stdin)) {
+		if ('\n' == line[0]) {
+			commit_batch();
+			continue;
+		}
+		if (BATCH_MAX == nbatch)
+			commit_batch();
+		r = &batch[nbatch];
+		if (2 != sscanf(line, "%511s %llu", name, &len)) {
+			discard_batch();
+			errx(1, "bad frame header");
+		}
+		if (strchr(name, '/') || '.' == name[0]) {
+			discard_batch();
+			errx(1, "'/' or leading '.' is not allowed in filename");
+		}
+		nlen = strlen(name);
+		if (nlen >= sizeof(r->name) ||
+		    1 + nlen + sizeof(".XXXXXX") > sizeof(r->tmp)) {
+			discard_batch();
+			errx(1, "filename too long");
+		}
+		memcpy(r->name, name, nlen + 1);
+		r->tmp[0] = '.';
+		memcpy(r->tmp + 1, name, nlen);
+		memcpy(r->tmp + 1 + nlen, ".XXXXXX", sizeof(".XXXXXX"));
+		if ((fd = mkstemp(r->tmp)) < 0 || NULL == (out = fdopen(fd, "w"))) {
+			discard_batch();
+			err(1, "%s", r->tmp);
+		}
+		fchmod(fd, 0660);
+		nbatch++;
+		setvbuf(out, NULL, _IOFBF, IOBUF);
+		MD5Init(&md5);
+		for (left = len; left; left -= n) {
+			n = fread(buf, 1, left < sizeof(buf) ? left : sizeof(buf), stdin);
+			if (0 == n) {
+				discard_batch();
+				errx(1, "%s: short frame", r->name);
+			}
+			MD5Update(&md5, buf, n);
+			if (fwrite(buf, 1, n, out) != n) {
+				discard_batch();
+				err(1, "write");
+			}
+		}
+#ifndef __linux__
+		if (fflush(out) != 0 || fsync(fd) < 0) {
+			discard_batch();
+			err(1, "write");
+		}
+#endif
+		if (fclose(out) != 0) {
+			discard_batch();
+			err(1, "write");
+		}
+		MD5End(&md5, r->md5);
+		if (NULL == fgets(digest, sizeof(digest), stdin)) {
+			discard_batch();
+			errx(1, "%s: no digest", r->name);
+		}
+		digest[strcspn(digest, "\r\n")] = '\0';
+		r->good = 0 == strcasecmp(digest, r->md5);
+	}
+	commit_batch();
+}
 
 int
 main(int argc, char *argv[])
@@ -32,6 +220,7 @@ main(int argc, char *argv[])
 
 	if (argc != 2) {
 		fprintf(stderr, "usage: %s filename\n", argv[0]);
+		fprintf(stderr, "       %s -m\n", argv[0]);
 		return 1;
 	}
 
@@ -47,6 +236,11 @@ main(int argc, char *argv[])
 	if (chdir("dsc") < 0)
 		err(1, "$HOME/dsc");
 
+	if (0 == strcmp(fn, "-m")) {
+		recv_many();
+		return 0;
+	}
+
 	fd = open(fn, O_WRONLY|O_CREAT|O_EXCL, 0660);
 	if (fd < 0)
 		err(1, fn);
@@ -64,4 +258,3 @@ main(int argc, char *argv[])
 
 	return 0;
 }
-